@@ -0,0 +1,109 @@
+#pragma once
+
+// Alarm rule evaluation. Rules are a constexpr table; evaluateRule<Rules, I>()
+// is instantiated per row so every comparator, threshold and timer is a
+// compile-time constant. No Arduino dependencies, so the native test
+// environment (test/test_alarm_rules) runs and times it on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+
+namespace ventilation {
+
+enum class AlarmPriority : uint8_t { None = 0, Low, Medium, High };
+
+enum class AlarmCmp : uint8_t { Below, Above };
+
+// Signal is the caller's enum of inputs; it indexes the signals array
+template <typename Signal>
+struct AlarmRule {
+  const char* name;
+  Signal signal;
+  AlarmCmp cmp;
+  float threshold;
+  float hysteresis;    // Clears only once the signal is this far back past threshold
+  uint32_t delayOnMs;  // Condition must persist this long to raise
+  uint32_t delayOffMs; // ...and be gone this long to clear
+  AlarmPriority priority;
+  bool latching;       // Stays active after the condition clears until acknowledged
+};
+
+struct AlarmState {
+  bool condition = false; // Threshold crossed (after hysteresis)
+  bool active = false;
+  bool acked = false;
+  uint64_t changedUs = 0; // When condition last flipped
+};
+
+struct AlarmSummary {
+  bool anyFlipped = false;
+  bool active = false;
+  bool acked = true;
+  bool pending = false;
+  AlarmPriority priority = AlarmPriority::None;
+};
+
+// onEdge(rule, raised, value) runs when rule I becomes active or inactive
+template <const auto& Rules, size_t I, typename OnEdge>
+inline void evaluateRule(AlarmState* states, const float* signals, uint64_t nowUs,
+                         AlarmSummary& sum, OnEdge& onEdge) {
+  constexpr auto rule = Rules[I];
+  AlarmState& st = states[I];
+
+  const float v = signals[static_cast<size_t>(rule.signal)];
+  bool cond;
+  if constexpr (rule.cmp == AlarmCmp::Below) {
+    cond = v < (st.condition ? rule.threshold + rule.hysteresis : rule.threshold);
+  } else {
+    cond = v > (st.condition ? rule.threshold - rule.hysteresis : rule.threshold);
+  }
+
+  if (cond != st.condition) {
+    st.condition = cond;
+    st.changedUs = nowUs;
+    sum.anyFlipped = true;
+  }
+
+  const uint64_t heldUs = nowUs - st.changedUs;
+  if (st.condition) {
+    if (!st.active && heldUs >= rule.delayOnMs * 1000ULL) {
+      st.active = true;
+      st.acked = false;
+      onEdge(I, true, v);
+    }
+  } else if (st.active && heldUs >= rule.delayOffMs * 1000ULL) {
+    if constexpr (rule.latching) {
+      st.active = !st.acked;
+    } else {
+      st.active = false;
+    }
+    if (!st.active) {
+      onEdge(I, false, v);
+    }
+  }
+
+  sum.pending |= st.condition != st.active;
+  if (st.active) {
+    sum.active = true;
+    sum.acked &= st.acked;
+    if (rule.priority > sum.priority) sum.priority = rule.priority;
+  }
+}
+
+template <const auto& Rules, typename OnEdge, size_t... Is>
+inline void evaluateRules(AlarmState* states, const float* signals, uint64_t nowUs,
+                          AlarmSummary& sum, OnEdge& onEdge, std::index_sequence<Is...>) {
+  (evaluateRule<Rules, Is>(states, signals, nowUs, sum, onEdge), ...);
+}
+
+// One pass over every row of Rules; states holds one entry per row
+template <const auto& Rules, typename OnEdge>
+inline void evaluateRules(AlarmState* states, const float* signals, uint64_t nowUs,
+                          AlarmSummary& sum, OnEdge&& onEdge) {
+  constexpr size_t count = sizeof(Rules) / sizeof(Rules[0]);
+  evaluateRules<Rules>(states, signals, nowUs, sum, onEdge, std::make_index_sequence<count>{});
+}
+
+} // namespace ventilation
@@ -0,0 +1,84 @@
+#pragma once
+
+// SpO2 -> breathing rate controller. No Arduino dependencies, so the
+// native test environment (test/test_bpm_controller) replays SpO2 traces
+// through it on the host.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace ventilation {
+
+struct Spo2BpmPoint {
+  float spo2;
+  float bpm;
+};
+
+struct BpmControlParams {
+  const Spo2BpmPoint* curve; // Ascending SpO2, linear in between, flat beyond either end
+  size_t curveLen;
+  float spo2EmaTauMs;        // Time constant of the SpO2 filter
+  float maxSlewPerMin;       // Max change of the rate, BPM per minute
+  float hysteresis;          // Beyond the 0.5 rounding band
+  uint32_t maxDtMs;          // A longer gap between samples counts as this
+};
+
+struct BpmController {
+  float spo2Ema = NAN; // NAN until the first sample
+  float bpm = 0.0f;    // Continuous, slew-limited rate
+  int output = 0;
+  uint32_t lastMs = 0;
+};
+
+inline float mapSpo2ToBpm(const BpmControlParams& p, float spo2) {
+  if (spo2 <= p.curve[0].spo2) {
+    return p.curve[0].bpm;
+  }
+  for (size_t i = 1; i < p.curveLen; i++) {
+    const Spo2BpmPoint& a = p.curve[i - 1];
+    const Spo2BpmPoint& b = p.curve[i];
+    if (spo2 < b.spo2) {
+      return a.bpm + (b.bpm - a.bpm) * (spo2 - a.spo2) / (b.spo2 - a.spo2);
+    }
+  }
+  return p.curve[p.curveLen - 1].bpm;
+}
+
+// Restarts from bpm (boot, or an operator-set rate) without stepping: the
+// filter re-primes on the next sample and the rate slews from bpm
+inline void seedBpmController(BpmController& c, int bpm) {
+  c.spo2Ema = NAN;
+  c.bpm = static_cast<float>(bpm);
+  c.output = bpm;
+}
+
+// One SpO2 sample in, integer BPM out. Filter (time-based EMA, so the
+// sample rate does not matter), map onto the curve, slew-limit the
+// continuous rate, then only move the output once the rate is clearly past
+// the next integer, so noise near a step cannot make it flap.
+inline int updateBpmController(BpmController& c, const BpmControlParams& p, float spo2, uint32_t nowMs) {
+  if (isnan(spo2)) return c.output;
+  if (isnan(c.spo2Ema)) {
+    c.spo2Ema = spo2;
+    c.lastMs = nowMs;
+    return c.output;
+  }
+
+  const float dtMs = static_cast<float>(std::min(nowMs - c.lastMs, p.maxDtMs));
+  c.lastMs = nowMs;
+  c.spo2Ema += (spo2 - c.spo2Ema) * dtMs / (p.spo2EmaTauMs + dtMs);
+
+  const float maxStep = p.maxSlewPerMin * dtMs / 60000.0f;
+  const float step = mapSpo2ToBpm(p, c.spo2Ema) - c.bpm;
+  c.bpm += std::max(-maxStep, std::min(maxStep, step));
+
+  if (fabsf(c.bpm - static_cast<float>(c.output)) >= 0.5f + p.hysteresis) {
+    c.output = static_cast<int>(lroundf(c.bpm));
+  }
+  return c.output;
+}
+
+} // namespace ventilation
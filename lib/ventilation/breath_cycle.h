@@ -0,0 +1,54 @@
+#pragma once
+
+// Breath timing and trajectory math. No Arduino dependencies, so the
+// native test environment (test/test_breath_cycle) runs it on the host.
+
+#include <math.h>
+#include <stdint.h>
+
+namespace ventilation {
+
+// Cycle length in effect plus a staged change. A new rate never rescales
+// the breath in progress: it waits for the next exhale-complete boundary.
+struct CycleTiming {
+  uint32_t durationMs;
+  uint32_t pendingMs = 0; // Applied at the next cycle boundary (0 = none)
+};
+
+inline void stageRate(CycleTiming& c, int bpm) {
+  if (bpm <= 0) return;
+  c.pendingMs = 60000UL / static_cast<uint32_t>(bpm);
+}
+
+inline void applyPendingRate(CycleTiming& c) {
+  if (c.pendingMs != 0) {
+    c.durationMs = c.pendingMs;
+    c.pendingMs = 0;
+  }
+}
+
+// Sine easing: -0.5 * (cos(PI*x) - 1)
+inline float easeInOutSine(float t) {
+  return -0.5f * (cosf(3.14159265f * t) - 1.0f);
+}
+
+// Commanded angle elapsedMs into a cycle: eased rise to peakAngle over the
+// inhale fraction, eased fall back to minAngle over the rest.
+inline float trajectoryAngle(uint32_t elapsedMs, uint32_t cycleMs, float inhaleFraction,
+                             float minAngle, float peakAngle) {
+  const uint32_t inhaleMs = static_cast<uint32_t>(cycleMs * inhaleFraction);
+  if (elapsedMs < inhaleMs) {
+    const float t = static_cast<float>(elapsedMs) / static_cast<float>(inhaleMs);
+    return minAngle + (peakAngle - minAngle) * easeInOutSine(t);
+  }
+  const float t = static_cast<float>(elapsedMs - inhaleMs) / static_cast<float>(cycleMs - inhaleMs);
+  return peakAngle - (peakAngle - minAngle) * easeInOutSine(t);
+}
+
+// True if moving stepDeg in dtSec stays under the slew limit, with slackDeg
+// for output quantization
+inline bool withinSlewLimit(float stepDeg, float dtSec, float limitDegPerSec, float slackDeg) {
+  return fabsf(stepDeg) <= limitDegPerSec * dtSec + slackDeg;
+}
+
+} // namespace ventilation
@@ -0,0 +1,122 @@
+#pragma once
+
+// Lookups over the patient data log ring for /get_data and /stats: the
+// timestamp binary search and Largest-Triangle-Three-Buckets downsampling.
+// Both address rows by logical index (0 = oldest) through a caller's
+// accessor, so the ring is read in place. No Arduino dependencies, so the
+// native test environment (test/test_log_ring) runs them on a wrapped ring.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ventilation {
+
+// Physical slot of the i-th oldest of count rows, head being the next write
+inline size_t ringSlot(size_t head, size_t count, size_t capacity, size_t i) {
+  return (head + capacity - count + i) % capacity;
+}
+
+// First logical index in [0, count) whose timestampAt(i) is at or after tsUs,
+// or count if none. Stamps ascend from oldest to newest, so this is a binary
+// search: O(log n).
+template <typename TimestampAt>
+size_t ringLowerBound(size_t count, uint64_t tsUs, TimestampAt timestampAt) {
+  size_t lo = 0;
+  size_t hi = count;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (timestampAt(mid) < tsUs) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+template <size_t Metrics>
+struct LttbPoint {
+  float x;
+  float y[Metrics]; // Comparable scale across metrics, NAN when missing
+};
+
+// Mean of rows [begin, end); metrics with no data stay NAN
+template <size_t Metrics, typename PointAt>
+LttbPoint<Metrics> lttbAverage(size_t begin, size_t end, PointAt& pointAt) {
+  LttbPoint<Metrics> avg = {};
+  uint16_t counts[Metrics] = {};
+  for (size_t i = begin; i < end; i++) {
+    const LttbPoint<Metrics> pt = pointAt(i);
+    avg.x += pt.x;
+    for (size_t m = 0; m < Metrics; m++) {
+      if (isnan(pt.y[m])) continue;
+      avg.y[m] += pt.y[m];
+      counts[m]++;
+    }
+  }
+  avg.x /= static_cast<float>(end - begin);
+  for (size_t m = 0; m < Metrics; m++) {
+    avg.y[m] = counts[m] > 0 ? avg.y[m] / counts[m] : NAN;
+  }
+  return avg;
+}
+
+// Twice the triangle area, summed over the metrics present at all three
+template <size_t Metrics>
+float lttbArea(const LttbPoint<Metrics>& a, const LttbPoint<Metrics>& b, const LttbPoint<Metrics>& c) {
+  float area = 0.0f;
+  for (size_t m = 0; m < Metrics; m++) {
+    const float t = (a.x - c.x) * (b.y[m] - a.y[m]) - (a.x - b.x) * (c.y[m] - a.y[m]);
+    if (!isnan(t)) area += fabsf(t);
+  }
+  return area;
+}
+
+// Calls emit(i) for at most n logical rows of [first, last), in order.
+// Keeps the first and last rows; from each of the n - 2 buckets between
+// them it keeps the row forming the largest triangle with the previously
+// kept row and the next bucket's mean. pointAt(i) returns row i as an
+// LttbPoint<Metrics>; each row is read at most twice and nothing beyond the
+// output is buffered.
+template <size_t Metrics, typename PointAt, typename Emit>
+void lttbDownsample(size_t first, size_t last, size_t n, PointAt pointAt, Emit emit) {
+  const size_t count = last - first;
+  if (n >= count || n < 3) {
+    for (size_t i = first; i < last; i++) emit(i);
+    return;
+  }
+
+  const size_t buckets = n - 2;
+  const float bucketSize = static_cast<float>(count - 2) / buckets;
+  auto bucketStart = [&](size_t b) {
+    return b >= buckets ? last - 1 : first + 1 + static_cast<size_t>(b * bucketSize);
+  };
+
+  emit(first);
+  LttbPoint<Metrics> a = pointAt(first);
+  for (size_t b = 0; b < buckets; b++) {
+    const size_t begin = bucketStart(b);
+    const size_t end = bucketStart(b + 1);
+    const LttbPoint<Metrics> c =
+        lttbAverage<Metrics>(end, b + 1 < buckets ? bucketStart(b + 2) : last, pointAt);
+
+    size_t best = begin;
+    float bestArea = -1.0f;
+    LttbPoint<Metrics> bestPt = {};
+    for (size_t i = begin; i < end; i++) {
+      const LttbPoint<Metrics> pt = pointAt(i);
+      const float area = lttbArea(a, pt, c);
+      if (area > bestArea) {
+        bestArea = area;
+        best = i;
+        bestPt = pt;
+      }
+    }
+    emit(best);
+    a = bestPt;
+  }
+  emit(last - 1);
+}
+
+} // namespace ventilation
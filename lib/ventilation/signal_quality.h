@@ -0,0 +1,159 @@
+#pragma once
+
+// PPG signal quality index (SQI, 0-100) per window of raw samples. Three
+// checks on the raw PPG, each scored 0-1 and multiplied:
+//  - perfusion index: IR peak-to-peak over DC
+//  - morphology: correlation of each beat with a running beat template
+//  - motion: DC shift from the previous window
+// A clipped ADC or no finger scores 0 outright. Every raw sample updates the
+// window and beat sums in constant time; scores are computed at window end.
+// No Arduino dependencies, so the native test environment
+// (test/test_signal_quality) scores synthetic PPG on the host.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace ventilation {
+
+struct SqiParams {
+  uint16_t windowSamples;
+  uint16_t saturationRaw;     // Either LED at this level: ADC clipped
+  uint16_t minDcRaw;          // IR below this: no finger
+  float minPerfusionPct;      // Perfusion index scores 0 here...
+  float goodPerfusionPct;     // ...and 1 from here
+  float maxPerfusionPct;      // Above this the swing is artefact
+  float minCorrelation;       // Beat vs template, scores 0 here...
+  float goodCorrelation;      // ...and 1 from here
+  float motionDcChange;       // Window-to-window DC shift that scores 0
+  float templateAlpha;        // Template update weight of each clean beat
+  uint8_t templateMaxRejects; // Consecutive poor beats before the template is reseeded
+};
+
+// BeatLen samples are captured after each beat and compared with the template
+template <size_t BeatLen>
+struct SignalQuality {
+  // Current window
+  uint16_t samples = 0;
+  uint32_t irSum = 0;
+  uint16_t irMin = UINT16_MAX;
+  uint16_t irMax = 0;
+  uint16_t clipped = 0;
+  float corrSum = 0.0f;
+  uint8_t corrBeats = 0;
+
+  // Beat being captured: Pearson sums against the template
+  bool beatPending = false;  // Set by the caller's beat detector
+  uint8_t beatPos = BeatLen; // BeatLen = not capturing
+  uint16_t beatBase = 0;     // IR at the beat; samples are stored relative to it
+  float beat[BeatLen];
+  float sx = 0.0f, sy = 0.0f, sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+  float tmpl[BeatLen] = {};
+  bool haveTemplate = false;
+  uint8_t rejects = 0;
+
+  // Last completed window
+  float prevDc = NAN;
+  float perfusionPct = NAN;
+  float correlation = NAN;
+  float dcChange = NAN;
+  bool clippedWindow = false;
+  uint8_t score = 0;
+  uint32_t windows = 0;
+};
+
+inline float sqiRamp(float v, float lo, float hi) {
+  return std::max(0.0f, std::min(1.0f, (v - lo) / (hi - lo)));
+}
+
+template <size_t BeatLen>
+void finishBeat(SignalQuality<BeatLen>& q, const SqiParams& p) {
+  if (!q.haveTemplate || q.rejects >= p.templateMaxRejects) {
+    std::copy(q.beat, q.beat + BeatLen, q.tmpl);
+    q.haveTemplate = true;
+    q.rejects = 0;
+    return;
+  }
+
+  constexpr float n = static_cast<float>(BeatLen);
+  const float den = (n * q.sxx - q.sx * q.sx) * (n * q.syy - q.sy * q.sy);
+  const float r = den > 0.0f ? (n * q.sxy - q.sx * q.sy) / sqrtf(den) : 0.0f;
+  q.corrSum += r;
+  q.corrBeats++;
+
+  // Only clean beats shape the template
+  if (r >= p.minCorrelation) {
+    for (size_t i = 0; i < BeatLen; i++) {
+      q.tmpl[i] += p.templateAlpha * (q.beat[i] - q.tmpl[i]);
+    }
+    q.rejects = 0;
+  } else {
+    q.rejects++;
+  }
+}
+
+template <size_t BeatLen>
+void finishSqiWindow(SignalQuality<BeatLen>& q, const SqiParams& p) {
+  const float dc = static_cast<float>(q.irSum) / q.samples;
+  q.perfusionPct = dc > 0.0f ? (q.irMax - q.irMin) * 100.0f / dc : NAN;
+  q.correlation = q.corrBeats > 0 ? q.corrSum / q.corrBeats : NAN;
+  q.dcChange = isnan(q.prevDc) ? 0.0f : fabsf(dc - q.prevDc) / q.prevDc;
+  q.clippedWindow = q.clipped > 0;
+  q.prevDc = dc;
+  q.windows++;
+
+  float score = 0.0f;
+  if (!q.clippedWindow && dc >= p.minDcRaw && q.perfusionPct <= p.maxPerfusionPct) {
+    score = sqiRamp(q.perfusionPct, p.minPerfusionPct, p.goodPerfusionPct) *
+            (isnan(q.correlation) ? 0.0f : sqiRamp(q.correlation, p.minCorrelation, p.goodCorrelation)) *
+            (1.0f - std::min(1.0f, q.dcChange / p.motionDcChange));
+  }
+  q.score = static_cast<uint8_t>(lroundf(score * 100.0f));
+
+  q.samples = 0;
+  q.irSum = 0;
+  q.irMin = UINT16_MAX;
+  q.irMax = 0;
+  q.clipped = 0;
+  q.corrSum = 0.0f;
+  q.corrBeats = 0;
+}
+
+// Every raw sample. True when it completed a window (q.score is then fresh).
+template <size_t BeatLen>
+bool addSqiSample(SignalQuality<BeatLen>& q, const SqiParams& p, uint16_t ir, uint16_t red) {
+  q.samples++;
+  q.irSum += ir;
+  if (ir < q.irMin) q.irMin = ir;
+  if (ir > q.irMax) q.irMax = ir;
+  if (ir >= p.saturationRaw || red >= p.saturationRaw) q.clipped++;
+
+  if (q.beatPending) {
+    // A beat inside the previous capture drops it (rate above ~180 BPM)
+    q.beatPending = false;
+    q.beatPos = 0;
+    q.beatBase = ir;
+    q.sx = q.sy = q.sxx = q.syy = q.sxy = 0.0f;
+  }
+  if (q.beatPos < BeatLen) {
+    const float x = static_cast<float>(ir) - static_cast<float>(q.beatBase);
+    const float y = q.tmpl[q.beatPos];
+    q.beat[q.beatPos] = x;
+    q.sx += x;
+    q.sy += y;
+    q.sxx += x * x;
+    q.syy += y * y;
+    q.sxy += x * y;
+    if (++q.beatPos == BeatLen) finishBeat(q, p);
+  }
+
+  if (q.samples >= p.windowSamples) {
+    finishSqiWindow(q, p);
+    return true;
+  }
+  return false;
+}
+
+} // namespace ventilation
@@ -0,0 +1,184 @@
+#pragma once
+
+// Summary-statistics block index over a ring of logged rows (for /stats).
+// The ring is split into fixed blocks of BlockSize slots, and each block
+// keeps running moments, min/max and a coarse histogram per metric. A query
+// merges whole blocks and scans at most two partial blocks exactly:
+// O(n/B + B) instead of O(n). Percentiles come from the merged histogram, so
+// they are estimates; statPercentileError() gives their bound. No Arduino
+// dependencies, so the native test environment (test/test_stat_index)
+// checks it against a brute-force scan.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ventilation {
+
+struct StatBinning {
+  const char* name;
+  float lo;       // Lower edge of bin 0; values outside clamp to the edge bins
+  float binWidth;
+};
+
+struct StatAccum {
+  uint16_t count = 0;
+  double sum = 0.0;
+  double sumSq = 0.0;
+  float min = INFINITY;
+  float max = -INFINITY;
+};
+
+// One logged row as the index sees it
+template <size_t Metrics>
+struct StatRow {
+  uint64_t timestampUs;
+  float value[Metrics]; // NAN when not recorded
+};
+
+template <size_t Metrics, size_t Bins>
+struct StatBlock {
+  StatAccum acc[Metrics];
+  uint8_t hist[Metrics][Bins] = {}; // <= BlockSize per bin
+  uint8_t rows = 0;
+  uint64_t oldestUs = UINT64_MAX;   // Timestamp range of the block's rows
+  uint64_t newestUs = 0;
+};
+
+template <size_t Metrics, size_t Bins>
+struct StatResult {
+  StatAccum acc[Metrics];
+  uint16_t hist[Metrics][Bins] = {};
+  uint16_t rows = 0;
+};
+
+inline void statAdd(StatAccum& a, float v) {
+  a.count++;
+  a.sum += v;
+  a.sumSq += static_cast<double>(v) * v;
+  if (v < a.min) a.min = v;
+  if (v > a.max) a.max = v;
+}
+
+inline void statMerge(StatAccum& a, const StatAccum& b) {
+  a.count += b.count;
+  a.sum += b.sum;
+  a.sumSq += b.sumSq;
+  if (b.min < a.min) a.min = b.min;
+  if (b.max > a.max) a.max = b.max;
+}
+
+inline size_t statBin(const StatBinning& b, size_t bins, float v) {
+  const float bin = floorf((v - b.lo) / b.binWidth);
+  if (bin < 0.0f) return 0;
+  if (bin >= static_cast<float>(bins)) return bins - 1;
+  return static_cast<size_t>(bin);
+}
+
+// Adds one row's recorded metrics to acc/hist (a block's or a result's)
+template <size_t Metrics, size_t Bins, typename Count>
+inline void statAddRow(StatAccum (&acc)[Metrics], Count (&hist)[Metrics][Bins],
+                       const StatBinning* binning, const StatRow<Metrics>& row) {
+  for (size_t m = 0; m < Metrics; m++) {
+    const float v = row.value[m];
+    if (isnan(v)) continue;
+    statAdd(acc[m], v);
+    hist[m][statBin(binning[m], Bins, v)]++;
+  }
+}
+
+// Summary of physical slots [first, end); rowAt(slot) returns a StatRow
+template <size_t Metrics, size_t Bins, typename RowAt>
+StatBlock<Metrics, Bins> buildStatBlock(const StatBinning* binning, size_t first, size_t end,
+                                        RowAt rowAt) {
+  StatBlock<Metrics, Bins> b;
+  for (size_t slot = first; slot < end; slot++) {
+    const StatRow<Metrics> row = rowAt(slot);
+    statAddRow(b.acc, b.hist, binning, row);
+    b.rows++;
+    if (row.timestampUs < b.oldestUs) b.oldestUs = row.timestampUs;
+    if (row.timestampUs > b.newestUs) b.newestUs = row.timestampUs;
+  }
+  return b;
+}
+
+// Accumulates physical slots [first, last) into r. [oldestUs, newestUs] are
+// the stamps of the oldest and newest rows when the caller took its snapshot
+// of the ring. A row outside them was appended since, over a row of the
+// snapshot, and is left out. A whole block comes from blockAt(block) only if
+// it is complete and inside them: one rebuilt since the snapshot, or not yet
+// rebuilt after a write that preceded it, is scanned row by row instead.
+template <size_t BlockSize, size_t Capacity, size_t Metrics, size_t Bins, typename RowAt,
+          typename BlockAt>
+void statAccumulateSlots(const StatBinning* binning, size_t first, size_t last,
+                         uint64_t oldestUs, uint64_t newestUs, RowAt rowAt, BlockAt blockAt,
+                         StatResult<Metrics, Bins>& r) {
+  size_t slot = first;
+  while (slot < last) {
+    const size_t block = slot / BlockSize;
+    const size_t blockStart = block * BlockSize;
+    const size_t blockEnd = blockStart + BlockSize < Capacity ? blockStart + BlockSize : Capacity;
+    if (slot == blockStart && blockEnd <= last) {
+      const StatBlock<Metrics, Bins> b = blockAt(block);
+      if (b.rows == blockEnd - blockStart && b.oldestUs >= oldestUs && b.newestUs <= newestUs) {
+        for (size_t m = 0; m < Metrics; m++) {
+          statMerge(r.acc[m], b.acc[m]);
+          for (size_t i = 0; i < Bins; i++) {
+            r.hist[m][i] += b.hist[m][i];
+          }
+        }
+        r.rows += b.rows;
+        slot = blockEnd;
+        continue;
+      }
+    }
+    const StatRow<Metrics> row = rowAt(slot);
+    if (row.timestampUs >= oldestUs && row.timestampUs <= newestUs) {
+      statAddRow(r.acc, r.hist, binning, row);
+      r.rows++;
+    }
+    slot++;
+  }
+}
+
+// Accumulates len slots starting at physical startSlot, wrapping at Capacity:
+// a logical range of the ring maps onto at most two contiguous runs
+template <size_t BlockSize, size_t Capacity, size_t Metrics, size_t Bins, typename RowAt,
+          typename BlockAt>
+void statAccumulateRing(const StatBinning* binning, size_t startSlot, size_t len,
+                        uint64_t oldestUs, uint64_t newestUs, RowAt rowAt, BlockAt blockAt,
+                        StatResult<Metrics, Bins>& r) {
+  const size_t firstRun = len < Capacity - startSlot ? len : Capacity - startSlot;
+  statAccumulateSlots<BlockSize, Capacity>(binning, startSlot, startSlot + firstRun, oldestUs,
+                                           newestUs, rowAt, blockAt, r);
+  statAccumulateSlots<BlockSize, Capacity>(binning, 0, len - firstRun, oldestUs, newestUs,
+                                           rowAt, blockAt, r);
+}
+
+// Interpolated within the histogram bin, clamped to the observed min/max
+template <size_t Bins>
+float statPercentile(const StatAccum& a, const uint16_t (&hist)[Bins], const StatBinning& b, float p) {
+  const float target = p * a.count;
+  float cumulative = 0.0f;
+  for (size_t i = 0; i < Bins; i++) {
+    const float inBin = hist[i];
+    if (inBin > 0 && cumulative + inBin >= target) {
+      const float frac = (target - cumulative) / inBin;
+      const float v = b.lo + (i + frac) * b.binWidth;
+      return v < a.min ? a.min : (v > a.max ? a.max : v);
+    }
+    cumulative += inBin;
+  }
+  return a.max;
+}
+
+// Bound on |statPercentile() - nearest-rank percentile|. Both lie in the bin
+// where the cumulative count reaches the rank, so it is one bin width while
+// every value falls inside the binned range. NAN (no bound) once a value has
+// clamped into an edge bin.
+inline float statPercentileError(const StatAccum& a, const StatBinning& b, size_t bins) {
+  if (a.min < b.lo || a.max >= b.lo + bins * b.binWidth) return NAN;
+  return b.binWidth;
+}
+
+} // namespace ventilation
@@ -0,0 +1,63 @@
+#pragma once
+
+// Tidal volume control: the flow sensor's frame check and the once-per-breath
+// PID that trims the inhale peak angle. Integer-only (it runs inside the
+// control tick's budget). No Arduino dependencies, so the native test
+// environment (test/test_volume_control) runs it against a model lung.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace ventilation {
+
+// Sensirion CRC-8: polynomial 0x31, init 0xFF, no reflection, no final XOR
+inline uint8_t sensirionCrc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x31) : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Angles Q8 degrees, gains Q16 deg/mL
+struct VolumePidParams {
+  int32_t targetMl;
+  int32_t minPeakQ8;
+  int32_t maxPeakQ8; // The servo's ceiling
+  int32_t maxStepQ8; // Largest change per breath
+  int32_t kpQ16;
+  int32_t kiQ16;
+  int32_t kdQ16;
+};
+
+struct VolumeControl {
+  int32_t peakQ8;           // Inhale peak angle for the next breath
+  int32_t err1 = 0;         // Previous two volume errors (mL)
+  int32_t err2 = 0;
+  int32_t lastTidalMl = -1; // -1 = none measured yet
+};
+
+// Incremental (velocity-form) PID on one breath's tidal volume. The velocity
+// form keeps no integrator, so clamping the peak is itself the anti-windup:
+// after a stretch pinned at a limit, the first error of the other sign moves
+// the peak straight back. Returns the new peak.
+inline int32_t updateVolumePid(VolumeControl& v, const VolumePidParams& p, int32_t tidalMl) {
+  v.lastTidalMl = tidalMl;
+  const int32_t err = p.targetMl - tidalMl;
+  const int64_t acc = static_cast<int64_t>(p.kpQ16) * (err - v.err1) +
+                      static_cast<int64_t>(p.kiQ16) * err +
+                      static_cast<int64_t>(p.kdQ16) * (err - 2 * v.err1 + v.err2);
+  const int32_t stepQ8 = static_cast<int32_t>(
+      std::max<int64_t>(-p.maxStepQ8, std::min<int64_t>(p.maxStepQ8, acc >> 8)));
+  v.peakQ8 = std::max(p.minPeakQ8, std::min(p.maxPeakQ8, v.peakQ8 + stepQ8));
+  v.err2 = v.err1;
+  v.err1 = err;
+  return v.peakQ8;
+}
+
+} // namespace ventilation
@@ -4,9 +4,24 @@
 #include <MAX30100.h>
 #include <WiFi.h>
 #include <WebServer.h>
+#include <WiFiUdp.h>
 #include <Wire.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
+#include <Preferences.h>
+#include <driver/adc.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <algorithm>
+#include <ctime>
+#include <utility>
+#include <alarm_rules.h>
+#include <bpm_controller.h>
+#include <breath_cycle.h>
+#include <signal_quality.h>
+#include <log_ring.h>
+#include <stat_index.h>
+#include <volume_control.h>
 
 // NOTE: This is a hobby/demo control loop.
 // Ventilation is safety-critical—do not use for medical/clinical purposes.
@@ -16,12 +31,51 @@ namespace {
 constexpr int kServoPin = 18;
 constexpr int kI2cSdaPin = 21;
 constexpr int kI2cSclPin = 22;
+constexpr uint16_t kI2cTimeoutMs = 10; // Caps how long one transaction can wait on an absent device
+constexpr uint32_t kI2cClockHz = 400000;
+constexpr size_t kI2cQueueDepth = 8;
+constexpr size_t kI2cMaxQueuedPerPass = 4; // Queued transactions served per pass, after the oximeter's turn
+constexpr size_t kI2cMaxDevices = 4;       // Per-address statistics slots
+constexpr UBaseType_t kI2cTaskPriority = 2; // Above TaskSensor (1) on Core 0
+
+// MAX30100 bring-up: one I2C step per sensor-task pass, exponential backoff on failure
+constexpr uint32_t kOximeterBackoffMinMs = 250;
+constexpr uint32_t kOximeterBackoffMaxMs = 8000;
+constexpr uint32_t kOximeterHealthCheckMs = 1000; // Part ID read while running, detects unplugging
+
+// PPG signal quality index (SQI, 0-100) per window of raw samples, see
+// signal_quality.h; SpO2/HR are only published while the last window scored
+// kSqiGoodThreshold or more. Raw levels assume 16-bit high-resolution mode.
+// Tune on the bench.
+constexpr uint8_t kSqiGoodThreshold = 50;
+constexpr size_t kBeatTemplateLen = 16; // 320 ms after each beat, fits 180 BPM
+constexpr ventilation::SqiParams kSqi = {
+  150,    // Window: 3 s of 50 Hz raw samples
+  65000,  // ADC clipped
+  2000,   // No finger
+  0.2f,   // Perfusion index (%) scoring 0...
+  0.5f,   // ...and 1
+  20.0f,  // Perfusion index that is artefact
+  0.5f,   // Beat vs template correlation scoring 0...
+  0.9f,   // ...and 1
+  0.10f,  // Window-to-window DC shift scoring 0
+  0.2f,   // Template update weight
+  4,      // Poor beats before the template is reseeded
+};
 
 // DS18B20 (1-Wire)
 constexpr int kDs18b20DataPin = 4;
+constexpr size_t kMaxTempProbes = 4;        // The alarm probe (see g_alarmProbeAddr) drives the alarm and log
+constexpr uint8_t kTempResolutionBits = 11;
+constexpr uint32_t kTempPeriodMs = 1000;
+constexpr uint32_t kTempConvertMs = 400;    // 11-bit conversion is 375 ms max
+constexpr uint32_t kTempRescanMs = 5000;    // Bus search retry while no probe is found
+constexpr uint32_t kTempFullRescanMs = 60000; // Bus search with probes present, for hot-plugged ones
 
 // Buzzer for alarm
 constexpr int kBuzzerPin = 25;  // GPIO 25 for alarm buzzer
+constexpr uint8_t kBuzzerLedcChannel = 15; // Last channel, clear of ESP32Servo's allocations
+constexpr uint8_t kBuzzerLedcResolution = 10;
 
 // Alarm thresholds
 constexpr float kAlarmTempThresholdF = 80.0f;  // Below 80°F triggers alarm
@@ -31,13 +85,34 @@ constexpr float kAlarmSpo2Threshold = 80.0f;   // Below 80% triggers alarm
 constexpr const char* kApSsid = "DIY_Ventilator";
 constexpr const char* kApPassword = "12345678"; // 8+ chars required
 
+// Central station (optional). With kStaSsid set the device also joins that
+// network, keeping the hotspot for bedside use. With kAggregatorHost set it
+// pushes binary telemetry frames to tools/central_station/aggregator.py.
+constexpr const char* kStaSsid = "";
+constexpr const char* kStaPassword = "";
+constexpr const char* kAggregatorHost = ""; // e.g. "192.168.1.10"
+constexpr uint16_t kAggregatorPort = 7700;
+constexpr uint16_t kBedId = 1;
+constexpr uint32_t kTelemetryPushMs = 1000;
+constexpr uint32_t kAggregatorRetryMs = 5000;
+constexpr int32_t kAggregatorConnectTimeoutMs = 200; // Bounds the stall in loop()
+
+// UDP multicast telemetry (optional): the same frame sent to a group at a
+// fixed rate. One datagram per interval whatever the number of listeners;
+// see tools/central_station/multicast_listener.py.
+constexpr bool kMulticastEnabled = false;
+constexpr const char* kMulticastGroup = "239.255.77.1";
+constexpr uint16_t kMulticastPort = 7701;
+constexpr uint32_t kMulticastIntervalMs = 200;
+
 // BPM control password
 constexpr const char* kBpmPassword = "12345678";
 
-// Your SpO2-based rule table
-// < 90  -> 20 BPM
-// 90-95 -> 17 BPM
-// >=95  -> 15 BPM
+// Your SpO2-based rule table, now the anchors of a continuous curve
+// <= 90  -> 20 BPM
+// 92.5   -> 17 BPM
+// >= 95  -> 15 BPM
+// linear in between
 constexpr float kSpo2LowThreshold = 90.0f;
 constexpr float kSpo2MidThreshold = 95.0f;
 constexpr int kBpmLowSpo2 = 20;
@@ -45,17 +120,92 @@ constexpr int kBpmMidSpo2 = 17;
 constexpr int kBpmHighSpo2 = 15;
 constexpr int kFallbackBpm = 15; // When sensor is not visible/invalid
 
+// Ascending SpO2; flat beyond either end
+constexpr ventilation::Spo2BpmPoint kSpo2BpmCurve[] = {
+  {kSpo2LowThreshold, kBpmLowSpo2},
+  {(kSpo2LowThreshold + kSpo2MidThreshold) / 2.0f, kBpmMidSpo2},
+  {kSpo2MidThreshold, kBpmHighSpo2},
+};
+
+// SpO2 -> BPM controller (lib/ventilation/bpm_controller.h)
+constexpr float kSpo2EmaTauMs = 3000.0f;     // Time constant of the SpO2 filter
+constexpr float kBpmMaxSlewPerMin = 10.0f;   // Max change of the rate, BPM per minute
+constexpr float kBpmHysteresis = 0.25f;      // Beyond the 0.5 rounding band
+constexpr uint32_t kBpmControlMaxDtMs = 1000; // A longer gap between samples counts as this
+constexpr ventilation::BpmControlParams kBpmControl = {
+  kSpo2BpmCurve, sizeof(kSpo2BpmCurve) / sizeof(kSpo2BpmCurve[0]),
+  kSpo2EmaTauMs, kBpmMaxSlewPerMin, kBpmHysteresis, kBpmControlMaxDtMs,
+};
+
 // Servo settings
 // "360 degree and back to 0" implies a positional move.
 // Standard servos are 0-180. The user requested 90-degree range anti-clockwise.
 constexpr int kMinAngle = 0;
 constexpr int kMaxAngle = 90; // Modified range for 360-positional servo
 
+// Pulse range passed to attach(); ESP32Servo maps 0-180 deg onto it.
+// Driving the pulse directly gives ~0.1 deg steps instead of write()'s 1 deg.
+constexpr int kServoMinPulseUs = 500;
+constexpr int kServoMaxPulseUs = 2400;
+constexpr float kServoFullScaleDeg = 180.0f;
+
 // Timing model
 // Inhale = Up (0 -> Max), Exhale = Down (Max -> 0)
 // Smooth motion requires frequent updates, not delays.
 constexpr float kInhaleFraction = 0.4f; 
 
+// Control task (Core 1). Runs above the web server and lwIP (prio 18) so
+// HTTP load cannot delay servo updates; it blocks in vTaskDelayUntil otherwise.
+constexpr uint32_t kControlPeriodMs = 5;
+constexpr UBaseType_t kControlTaskPriority = 19;
+
+// Period jitter histogram bucket upper bounds (us); last bucket is overflow
+constexpr uint32_t kJitterBucketUs[] = {50, 100, 250, 500, 1000, 2000};
+constexpr size_t kJitterBucketCount = sizeof(kJitterBucketUs) / sizeof(kJitterBucketUs[0]) + 1;
+
+// Fastest legitimate sweep is 40 BPM: 90 deg over a 600 ms sine-eased inhale
+// peaks at ~235 deg/s. Anything faster than this is a trajectory glitch.
+constexpr float kServoSlewLimitDegPerSec = 300.0f;
+constexpr float kServoPulseStepDeg = kServoFullScaleDeg / (kServoMaxPulseUs - kServoMinPulseUs);
+
+// Optional servo position feedback (potentiometer tap on an ADC1 pin).
+// Sampled by the ADC DMA engine; Core 0 drains it, Core 1 only reads the result.
+constexpr bool kServoFeedbackEnabled = false;
+constexpr adc1_channel_t kServoFeedbackChannel = ADC1_CHANNEL_0; // GPIO 36 (VP)
+constexpr uint32_t kServoFeedbackSampleHz = 20000;
+constexpr uint16_t kFeedbackRawAtMinAngle = 410;   // 12-bit ADC reading at kMinAngle
+constexpr uint16_t kFeedbackRawAtMaxAngle = 2050;  // 12-bit ADC reading at kMaxAngle
+constexpr float kServoStallErrorDeg = 15.0f;       // Tracking error that counts as stalled
+constexpr float kServoLoadedDegPerSec = 180.0f;    // Slowest speed a healthy servo reaches under bag load
+constexpr uint32_t kServoStallMs = 1000;           // ...sustained for this long
+
+// Optional flow sensor: Sensirion SDP810-500Pa across a linear (screen)
+// pneumotach on the inspiratory limb, on the shared I2C bus. Read once per
+// control tick (200 Hz) and integrated to tidal volume in fixed point.
+constexpr bool kFlowSensorEnabled = false;
+constexpr uint8_t kFlowSensorAddress = 0x25;
+constexpr uint8_t kFlowStartCmd[2] = {0x36, 0x1E}; // Continuous mass-flow mode, no averaging
+constexpr int32_t kFlowCountsPerPa = 60;           // SDP810-500Pa scale factor
+constexpr int32_t kFlowUlPerSecPerPa = 5000;       // Pneumotach gain (0.5 L/s at 100 Pa); calibrate per element
+constexpr uint8_t kFlowMaxFailures = 20;           // Consecutive bad reads before re-sending start
+constexpr uint32_t kFlowMinBreathSamples = 20;     // Fewer inhale samples than this: no volume update
+constexpr int64_t kFlowMaxSampleGapUs = 4 * kControlPeriodMs * 1000; // Longer gaps integrate as this
+
+// Volume control: incremental PID run once per breath, trimming the inhale
+// peak angle (kMaxAngle is the ceiling). Angles Q8 degrees, gains Q16 deg/mL.
+constexpr ventilation::VolumePidParams kVolumePid = {
+  400,            // Target tidal volume, mL
+  20 << 8,        // Min peak
+  kMaxAngle << 8, // Max peak
+  5 << 8,         // At most 5 deg change per breath
+  1311,           // Kp 0.02 deg/mL
+  2949,           // Ki 0.045 deg/mL per breath
+  0,              // Kd
+};
+// Per-tick cost of sampling + integration (and the breath-end PID update)
+// must stay under this: 20 us at 240 MHz, 0.4% of the 5 ms period.
+constexpr uint32_t kFlowBudgetCycles = 4800;
+
 Servo g_servo;
 PulseOximeter g_pox;
 MAX30100 g_max30100; // Raw sensor access for PPG waveform
@@ -66,15 +216,161 @@ DallasTemperature g_ds18b20(&g_oneWire);
 
 bool g_ventilatorRunning = false; // Controls if breathing cycle is active
 bool g_manualMode = false;        // Manual SpO2 override
+int g_lastServoPulseUs = -1;      // Last pulse written, to skip redundant LEDC writes
 float g_manualSpo2 = 90.0f;       // Default manual value
 
-// Alarm state
+// Timebase
+// All stored timestamps are microseconds on one 64-bit monotonic clock
+// (esp_timer), which does not wrap. Once a client supplies the time via
+// /set_time, exports can also show absolute wall-clock time.
+inline uint64_t timebaseUs() {
+  return static_cast<uint64_t>(esp_timer_get_time());
+}
+
+volatile bool g_wallClockSet = false;
+int64_t g_wallClockOffsetMs = 0; // epoch ms - timebase ms; guarded by g_sharedTimeMux
+int32_t g_tzOffsetMin = 0;       // Client's Date.getTimezoneOffset(), for readable exports
+// Every dashboard load sends /set_time; re-anchoring shifts every stored
+// timestamp's display, so once set the clock only moves for a real drift
+constexpr int64_t kWallClockMaxDriftMs = 5000;
+
+// Protects 64-bit values shared between cores (not atomic on the ESP32)
+portMUX_TYPE g_sharedTimeMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Boot instrumentation: timebase at each phase of bring-up, reported in
+// /status. Each slot is written once, so a 32-bit store is safe to read
+// from any core.
+enum BootPhase : uint8_t {
+  kBootSetup = 0,   // setup() entered
+  kBootSettings,    // Settings and alarm journal loaded from NVS
+  kBootServo,       // Servo attached and parked
+  kBootControl,     // TaskControl running
+  kBootFirstBreath, // First inhale started
+  kBootSensor,      // Oximeter first reported OK
+  kBootWifi,        // Hotspot up
+  kBootServer,      // Web server listening
+  kBootPhaseCount
+};
+
+constexpr const char* kBootPhaseNames[kBootPhaseCount] = {
+  "setup", "settings", "servo", "control", "first_breath", "sensor", "wifi", "server",
+};
+
+uint32_t g_bootPhaseUs[kBootPhaseCount] = {}; // 0 = not reached yet
+
+void markBootPhase(BootPhase phase) {
+  if (g_bootPhaseUs[phase] != 0) return;
+  const uint64_t us = timebaseUs();
+  g_bootPhaseUs[phase] = us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+}
+
+// Alarm engine
+// Rules are a constexpr table evaluated by lib/ventilation/alarm_rules.h.
+// Adding a rule is one table row as long as it reads one of the AlarmSignal values.
+using ventilation::AlarmCmp;
+using ventilation::AlarmPriority;
+
+enum class AlarmSignal : uint8_t {
+  Spo2 = 0,
+  HeartRate,
+  TempF,
+  SensorOk,     // 1 = sensor online, 0 = lost
+  Spo2AgeMs,    // Time since the last published SpO2/HR sample
+  TempAgeMs,    // Time since the last published temperature sample
+  ServoStall,   // 1 = stalled, 0 = tracking
+  SignalQuality, // PPG SQI 0-100 (100 while the sensor is out or in manual mode)
+  Count
+};
+
+using AlarmRule = ventilation::AlarmRule<AlarmSignal>;
+
+constexpr AlarmRule kAlarmRules[] = {
+  {"spo2_low",    AlarmSignal::Spo2,        AlarmCmp::Below, kAlarmSpo2Threshold,  2.0f, 2000, 3000, AlarmPriority::High,   true},
+  {"temp_low",    AlarmSignal::TempF,       AlarmCmp::Below, kAlarmTempThresholdF, 1.0f, 2000, 5000, AlarmPriority::Medium, false},
+  {"hr_low",      AlarmSignal::HeartRate,   AlarmCmp::Below, 40.0f,                5.0f, 5000, 5000, AlarmPriority::Medium, false},
+  {"hr_high",     AlarmSignal::HeartRate,   AlarmCmp::Above, 150.0f,               5.0f, 5000, 5000, AlarmPriority::Medium, false},
+  {"sensor_lost", AlarmSignal::SensorOk,    AlarmCmp::Below, 0.5f,                 0.0f, 5000, 2000, AlarmPriority::Medium, false},
+  {"spo2_stale",  AlarmSignal::Spo2AgeMs,   AlarmCmp::Above, 10000.0f,             0.0f, 0,    0,    AlarmPriority::Low,    false},
+  {"servo_stall", AlarmSignal::ServoStall,  AlarmCmp::Above, 0.5f,                 0.0f, 0,    0,    AlarmPriority::High,   true},
+  // SpO2/HR are held at their last good values meanwhile, so spo2_low cannot
+  // fire: Medium, not Low, since a real desaturation may be hidden behind it
+  {"signal_poor", AlarmSignal::SignalQuality, AlarmCmp::Below, kSqiGoodThreshold,  10.0f, 5000, 3000, AlarmPriority::Medium, false},
+  // Appended, so the journal and telemetry alarm bits of older rows keep their index
+  {"temp_stale",  AlarmSignal::TempAgeMs,   AlarmCmp::Above, 10000.0f,             0.0f, 0,    0,    AlarmPriority::Low,    false},
+};
+constexpr size_t kAlarmCount = sizeof(kAlarmRules) / sizeof(kAlarmRules[0]);
+
+// Time-derived signals (sample ages) change without a new sample arriving
+constexpr uint32_t kAlarmHousekeepingMs = 500;
+
+ventilation::AlarmState g_alarms[kAlarmCount];
 bool g_alarmActive = false;
-uint32_t g_lastAlarmCheckMs = 0;
+bool g_alarmAcked = false;           // Every active alarm has been acknowledged
+AlarmPriority g_alarmPriority = AlarmPriority::None;
+bool g_alarmTimersPending = false;   // A delay or latch still needs ticking
+uint64_t g_alarmLastEvalUs = 0;
+volatile bool g_alarmAckRequest = false;
+uint32_t g_alarmSeenSeq = 0;
+bool g_alarmSeenStall = false;
+
+// Sample -> alarm evaluation latency, for samples that flipped a condition.
+// Bounded by kControlPeriodMs since TaskControl checks for new samples every tick.
+uint32_t g_alarmLatencyUsLast = 0;
+uint32_t g_alarmLatencyUsMax = 0;
+uint32_t g_alarmEvalCyclesMax = 0; // CPU cycles for one pass over all rules
+
+// Alarm journal: fixed ring of onset/clear/ack records, addressed by a
+// monotonic sequence number (slot = seq % size). Appends are O(1) and never
+// allocate; dirty slots are written to NVS later from loop().
+struct AlarmEvent {
+  uint32_t seq;     // 0 = empty slot
+  uint16_t boot;    // Boot counter
+  uint8_t rule;     // Index into kAlarmRules
+  bool acked;
+  float value;      // Signal value when the alarm raised
+  bool wallClock;   // Times are epoch ms if set, else ms since boot `boot`
+  uint64_t onsetMs;
+  uint64_t clearMs; // 0 while still active, kJournalUnterminated if the boot ended first
+  uint64_t ackMs;   // 0 until acknowledged
+};
+
+constexpr size_t kAlarmJournalSize = 64;
+constexpr uint32_t kAlarmJournalFlushMs = 10000;
+constexpr size_t kAlarmJournalFlushMaxSlots = 4; // Bounds one flush; the rest waits for the next
+constexpr uint64_t kJournalUnterminated = UINT64_MAX;
+constexpr size_t kAlarmQueryDefaultLimit = 20;
+
+AlarmEvent g_alarmJournal[kAlarmJournalSize];
+uint32_t g_alarmJournalNextSeq = 1;
+uint64_t g_alarmJournalDirty = 0;           // One bit per slot
+uint32_t g_alarmOpenSeq[kAlarmCount] = {};  // Journal entry of the current episode per rule
+uint16_t g_bootCount = 0;
+uint32_t g_alarmJournalFlushUsMax = 0; // Longest flush, i.e. worst flash-cache stall it caused
+portMUX_TYPE g_alarmJournalMux = portMUX_INITIALIZER_UNLOCKED;
+Preferences g_prefs;
+
+// Last operator settings, restored at power-on so ventilation resumes
+// without waiting for Wi-Fi or the oximeter
+constexpr uint8_t kSettingsVersion = 2;
+constexpr uint32_t kSettingsAutoBpmSaveMs = 60000; // Rate limit for sensor-driven BPM changes
+constexpr uint32_t kSettingsFlushMs = 2000;        // Coalesces a burst of operator changes into one write
+
+// The manual SpO2 override is deliberately not kept: a reboot always comes
+// back in auto mode, following the oximeter, never on a stale bedside value
+struct SavedSettings {
+  uint8_t version;
+  bool running;
+  int16_t targetBpm;
+};
+
+Preferences g_settingsPrefs;
+int g_savedTargetBpm = -1;
+bool g_settingsDirty = false;     // Set by the HTTP handlers, written by flushSettings() (both loopTask)
+uint32_t g_settingsSaveUsMax = 0; // Longest settings write, i.e. worst flash-cache stall it caused
 
 // Data logging for PDF export
 struct PatientDataPoint {
-  uint32_t timestamp;
+  uint64_t timestampUs;
   float spo2;
   float heartRate;
   float tempF;
@@ -85,7 +381,73 @@ constexpr size_t kMaxDataPoints = 720; // 720 points at 1/min = 12 hours max
 PatientDataPoint g_dataLog[kMaxDataPoints];
 size_t g_dataLogHead = 0;
 size_t g_dataLogCount = 0;
-uint32_t g_lastDataLogMs = 0;
+uint64_t g_lastDataLogUs = 0;
+
+// TaskControl appends rows and rebuilds stat blocks; the HTTP handlers read
+// them on the other core. Rows, head/count and g_statBlocks change only under
+// this lock, and readers copy one row or one block at a time out from under
+// it (never format inside it).
+portMUX_TYPE g_dataLogMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Head/count as of the start of a query, so logical indices stay stable,
+// and the stamps of the oldest and newest rows at that moment
+struct LogView {
+  size_t head;
+  size_t count;
+  uint64_t oldestUs;
+  uint64_t newestUs;
+};
+
+// Per-breath metrics, finalized by updateBreathing() at each cycle boundary
+// from accumulators updated every control tick. Addressed by seq like the
+// alarm journal but kept in RAM only.
+struct BreathRecord {
+  uint32_t seq;          // 0 = empty slot
+  uint64_t startUs;      // Timebase at the start of inhale
+  uint32_t durationUs;   // Actual cycle length
+  uint32_t inhaleUs;     // Start to the first exhale tick
+  int32_t timingErrorUs; // durationUs minus the target cycle length
+  float peakAngle;       // Highest commanded angle
+  float spo2;            // Means over the breath (NAN without data)
+  float heartRate;
+  int16_t tidalMl;       // -1 without a valid flow measurement
+  uint8_t targetBpm;
+};
+
+constexpr size_t kBreathLogSize = 128;
+constexpr size_t kBreathQueryDefaultLimit = 20;
+
+BreathRecord g_breathLog[kBreathLogSize];
+uint32_t g_breathLogNextSeq = 1;
+portMUX_TYPE g_breathLogMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Summary-statistics index over g_dataLog (for /stats), see stat_index.h.
+// The index costs about 12.6 KB (45 blocks of 280 B for B = 16). Only the
+// written slot's block is rebuilt when data is logged.
+enum StatMetric : uint8_t {
+  kStatSpo2 = 0,
+  kStatHr,
+  kStatTempF,
+  kStatBpm,
+  kStatMetricCount
+};
+
+constexpr size_t kStatBins = 32;
+constexpr ventilation::StatBinning kStatBinning[kStatMetricCount] = {
+  {"spo2",       68.0f, 1.0f},   // 68-100 %
+  {"hr",         30.0f, 5.0f},   // 30-190 BPM
+  {"temp_f",     80.0f, 1.0f},   // 80-112 F
+  {"target_bpm",  4.0f, 1.25f},  // 4-44 BPM
+};
+
+constexpr size_t kStatBlockSize = 16;
+constexpr size_t kStatBlockCount = (kMaxDataPoints + kStatBlockSize - 1) / kStatBlockSize;
+
+using StatRow = ventilation::StatRow<kStatMetricCount>;
+using StatBlock = ventilation::StatBlock<kStatMetricCount, kStatBins>;
+using StatResult = ventilation::StatResult<kStatMetricCount, kStatBins>;
+
+StatBlock g_statBlocks[kStatBlockCount];
 
 // Shared variables for Inter-Task Communication (Core 0 <-> Core 1)
 volatile float g_sharedSpo2 = NAN;
@@ -93,9 +455,37 @@ volatile float g_sharedHr = NAN;
 volatile bool g_sharedSensorOk = false;
 volatile int g_sharedTargetBpm = kBpmHighSpo2;
 
+// SpO2 -> BPM controller state, owned by TaskControl (read by /status)
+ventilation::BpmController g_bpmCtl; // TaskControl only; seeded in setup()
+volatile int g_bpmSeedRequest = 0;   // Rate set by /set_bpm for TaskControl to seed from (0 = none)
+
 volatile float g_sharedTempC = NAN;
+
+// DS18B20 probes, addresses cached at discovery (TaskSensor writes, /status reads)
+DeviceAddress g_tempProbeAddr[kMaxTempProbes];
+volatile float g_sharedProbeTempC[kMaxTempProbes] = {NAN, NAN, NAN, NAN};
+volatile size_t g_tempProbeCount = 0;
+// The probe that drives the temperature alarm and log, fixed by address when
+// first found (lowest ROM). A probe added later sorts into the list around it
+// but never takes its role, and while it is missing there is no temperature
+// (temp_stale raises) rather than another probe's reading.
+DeviceAddress g_alarmProbeAddr;
+volatile bool g_alarmProbeKnown = false;
+volatile size_t g_alarmProbeIndex = kMaxTempProbes; // Its slot in g_tempProbeAddr, kMaxTempProbes = missing
 volatile bool g_sharedBeatDetected = false;
-volatile uint32_t g_sharedLastBeatMs = 0;
+uint64_t g_sharedLastBeatUs = 0; // Guarded by g_sharedTimeMux
+
+volatile float g_sharedServoFeedbackDeg = NAN; // Measured servo angle (Core 0 -> Core 1)
+
+// Bumped whenever a new SpO2/temperature sample is published; lets the alarm
+// engine react to data instead of polling it.
+volatile uint32_t g_sharedSampleSeq = 0;
+uint64_t g_sharedSampleUs = 0;     // Newest sample of either sensor; guarded by g_sharedTimeMux
+uint64_t g_sharedSpo2SampleUs = 0; // Per sensor, for the stale-data rules; same guard
+uint64_t g_sharedTempSampleUs = 0;
+// Bumped only for oximeter readings that passed the SQI gate, so held
+// values are never fed to the rate controller as new ones
+volatile uint32_t g_sharedSpo2Seq = 0;
 
 // PPG Waveform data for real-time display
 constexpr size_t kPpgBufferSize = 50; // Last 50 samples
@@ -103,91 +493,563 @@ volatile uint16_t g_ppgBuffer[kPpgBufferSize];
 volatile size_t g_ppgBufferIndex = 0;
 volatile bool g_ppgDataReady = false;
 
+// Oximeter bring-up state (TaskI2c only; /status reads SensorSnapshot)
+enum class OxState : uint8_t {
+  Probe,          // Address ACK
+  PartId,         // Part ID register matches
+  PoxBegin,       // PulseOximeter library init
+  RawMode,        // Raw driver for the PPG waveform, one register per step
+  RawPulseWidth,
+  RawSampleRate,
+  RawLedCurrent,
+  Ready,          // Running; periodic part ID health check
+};
+
+constexpr const char* kOxStateNames[] = {
+  "probe", "part_id", "pox_begin", "raw_mode", "raw_pulse_width", "raw_sample_rate", "raw_led_current", "ready",
+};
+
+struct OximeterInit {
+  OxState state = OxState::Probe;
+  uint32_t nextStepMs = 0;
+  uint32_t backoffMs = kOximeterBackoffMinMs;
+  uint32_t steps = 0;
+  uint32_t stepFailures = 0;
+  uint32_t stepMaxUs = 0;
+  uint32_t bringUps = 0;
+};
+
+OximeterInit g_ox;
+
+// Signal quality accumulators (TaskI2c only; /status reads SensorSnapshot)
+using SignalQuality = ventilation::SignalQuality<kBeatTemplateLen>;
+
+SignalQuality g_sqi;
+volatile uint8_t g_sharedSqi = 0;
+
+// I2C bus: TaskI2c is the only code that touches Wire. The MAX30100 is
+// driven from TaskI2c itself (through its library, on Wire directly); the
+// flow sensor's reads come from TaskControl as raw transactions through
+// g_i2cQueue (see i2cSubmit()), which it polls without ever blocking.
+struct I2cTransaction {
+  uint8_t address;
+  const uint8_t* tx;
+  size_t txLen;
+  uint8_t* rx;
+  size_t rxLen;
+  bool ok;
+  volatile bool done;
+};
+
+struct I2cDeviceStats {
+  uint8_t address = 0; // 0 = free slot
+  uint32_t transactions = 0;
+  uint32_t errors = 0;
+  uint32_t maxUs = 0;
+  uint64_t busyUs = 0; // Guarded by g_sharedTimeMux
+};
+
+QueueHandle_t g_i2cQueue = nullptr;
+
+bool i2cSubmit(I2cTransaction* t);
+
+// Flow channel and volume controller (TaskControl only; /status reads ControlSnapshot)
+struct FlowChannel {
+  I2cTransaction txn = {};  // Reused every tick; at most one in flight
+  uint8_t rx[3] = {};       // Differential pressure MSB, LSB, CRC
+  bool inFlight = false;
+  bool stale = false;       // In-flight read predates a stop/start; discard its result
+  bool started = false;     // Continuous mode running
+  uint8_t failures = 0;     // Consecutive
+  uint32_t samples = 0;
+  uint32_t errors = 0;
+  uint64_t lastSampleUs = 0;
+  int32_t flowUlPerSec = 0;
+  int32_t inhaleVolumeUl = 0; // Current breath
+  uint32_t breathSamples = 0; // Inhale samples this breath
+  uint32_t cyclesMax = 0;
+  uint32_t budgetOverruns = 0;
+};
+
+FlowChannel g_flow;
+ventilation::VolumeControl g_volume = {kVolumePid.maxPeakQ8};
+I2cDeviceStats g_i2cStats[kI2cMaxDevices];
+uint32_t g_i2cRecoveries = 0;
+
 struct Telemetry {
   float spo2 = NAN;
   float heartRate = NAN;
   bool sensorOk = false;
+  uint8_t sqi = 0; // PPG signal quality of the last window, 0-100
   int targetBpm = kBpmHighSpo2;
 
   float tempC = NAN;
   bool beatDetected = false;
-  uint32_t lastBeatMs = 0;
+  uint64_t lastBeatUs = 0;
   
   // PPG waveform data
   uint16_t ppgData[kPpgBufferSize];
   size_t ppgDataCount = 0;
   
   // Timing state
-  uint32_t cycleStartMs = 0;
-  uint32_t cycleDurationMs = 60000 / kBpmHighSpo2;
+  uint64_t cycleStartUs = 0;
+  ventilation::CycleTiming cycle = {60000 / kBpmHighSpo2};
+
+  // Current breath, folded into a BreathRecord at the cycle boundary
+  uint32_t breathInhaleUs = 0; // 0 until the first exhale tick
+  float breathPeakAngle = kMinAngle;
+  float breathSpo2Sum = 0.0f;
+  uint32_t breathSpo2Ticks = 0;
+  float breathHrSum = 0.0f;
+  uint32_t breathHrTicks = 0;
+
+  // Servo slew instrumentation
+  float lastAngle = kMinAngle;
+  uint64_t lastAngleUs = 0;
+  float peakSlewDegPerSec = 0.0f;
+  uint32_t slewViolations = 0;
+
+  // Servo feedback tracking (commanded vs measured angle)
+  float lagModelAngle = kMinAngle; // Command slew-limited to kServoLoadedDegPerSec
+  uint32_t trackSamples = 0;
+  float trackErrAbsSum = 0.0f;
+  float trackErrSqSum = 0.0f;
+  float trackErrMax = 0.0f;
+  uint64_t trackErrSinceUs = 0; // Start of the current over-limit stretch (0 = within limit)
+  bool servoStall = false;
 };
 
 Telemetry g_t;
 
-int computeTargetBpm(float spo2) {
-  if (spo2 < kSpo2LowThreshold) {
-    return kBpmLowSpo2;
+// Consistent copy of the control state for loopTask (HTTP handlers and
+// telemetry). TaskControl publishes it at the end of every tick; readers
+// copy it out under the lock and format from the copy.
+struct ControlSnapshot {
+  Telemetry t;
+  ventilation::BpmController bpmCtl;
+  bool alarmActive;
+  bool alarmAcked;
+  AlarmPriority alarmPriority;
+  uint32_t alarmMask; // Bit i = kAlarmRules[i] active
+  FlowChannel flow;
+  ventilation::VolumeControl volume;
+};
+
+ControlSnapshot g_snapshot;
+portMUX_TYPE g_snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+
+// The same for TaskI2c's oximeter state: published after every pass
+struct SensorSnapshot {
+  OximeterInit ox;
+  float perfusionPct = NAN; // Last completed SQI window
+  float correlation = NAN;
+  float dcChange = NAN;
+  bool clippedWindow = false;
+  uint32_t windows = 0;
+};
+
+SensorSnapshot g_sensorSnapshot;
+portMUX_TYPE g_sensorSnapshotMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool g_restartCycleRequest = false; // Set by /start, applied by TaskControl
+
+ControlSnapshot readSnapshot() {
+  portENTER_CRITICAL(&g_snapshotMux);
+  const ControlSnapshot copy = g_snapshot;
+  portEXIT_CRITICAL(&g_snapshotMux);
+  return copy;
+}
+
+SensorSnapshot readSensorSnapshot() {
+  portENTER_CRITICAL(&g_sensorSnapshotMux);
+  const SensorSnapshot copy = g_sensorSnapshot;
+  portEXIT_CRITICAL(&g_sensorSnapshotMux);
+  return copy;
+}
+
+// Control period jitter, written by TaskControl and read by /status
+uint32_t g_controlJitterHist[kJitterBucketCount] = {};
+uint32_t g_controlJitterMaxUs = 0;
+
+uint64_t readShared(const uint64_t& v) {
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  const uint64_t copy = v;
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+  return copy;
+}
+
+void writeShared(uint64_t& v, uint64_t value) {
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  v = value;
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+}
+
+// Arduino String has no portable 64-bit constructor across core versions
+String u64ToString(uint64_t v) {
+  char buf[21];
+  snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(v));
+  return String(buf);
+}
+
+int64_t wallClockOffsetMs() {
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  const int64_t offset = g_wallClockSet ? g_wallClockOffsetMs : 0;
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+  return offset;
+}
+
+// Timebase value as ms on the clock clients see: epoch ms once the wall
+// clock is anchored, otherwise ms since boot.
+uint64_t displayMs(uint64_t us) {
+  return static_cast<uint64_t>(static_cast<int64_t>(us / 1000) + wallClockOffsetMs());
+}
+
+uint64_t timebaseUsFromDisplayMs(uint64_t ms) {
+  const int64_t local = static_cast<int64_t>(ms) - wallClockOffsetMs();
+  return local > 0 ? static_cast<uint64_t>(local) * 1000ULL : 0;
+}
+
+// sensorUs is that sensor's g_shared*SampleUs. TaskI2c, TaskSensor and
+// loopTask all publish and preempt each other, so the increment is done
+// under the lock: a lost one would hide a sample from its readers.
+void publishSample(uint64_t& sensorUs) {
+  const uint64_t now = timebaseUs();
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  sensorUs = now;
+  g_sharedSampleUs = now;
+  g_sharedSampleSeq = g_sharedSampleSeq + 1;
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+}
+
+void publishSpo2Sample() {
+  publishSample(g_sharedSpo2SampleUs);
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  g_sharedSpo2Seq = g_sharedSpo2Seq + 1;
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+}
+
+void recomputeCycle(int bpm) {
+  // Staged: changing the duration mid-cycle would rescale elapsed/duration
+  // and make the servo jump. updateBreathing() applies it once exhale completes.
+  ventilation::stageRate(g_t.cycle, bpm);
+}
+
+void applyPendingCycle() {
+  ventilation::applyPendingRate(g_t.cycle);
+}
+
+int angleToPulseUs(float angle) {
+  return kServoMinPulseUs +
+         static_cast<int>(lroundf(angle * (kServoMaxPulseUs - kServoMinPulseUs) / kServoFullScaleDeg));
+}
+
+void writeServoAngle(float angle) {
+  const int pulseUs = angleToPulseUs(angle);
+  if (pulseUs == g_lastServoPulseUs) return; // Duty unchanged, skip the LEDC update
+  g_lastServoPulseUs = pulseUs;
+  g_servo.writeMicroseconds(pulseUs);
+}
+
+// Records the angular rate between consecutive servo writes. One pulse step
+// of slack absorbs the microsecond quantization.
+void trackServoSlew(float angle, uint64_t nowUs) {
+  if (g_t.lastAngleUs != 0 && nowUs != g_t.lastAngleUs) {
+    const float dtSec = static_cast<float>(nowUs - g_t.lastAngleUs) / 1e6f;
+    const float step = fabsf(angle - g_t.lastAngle);
+    const float rate = step / dtSec;
+    if (rate > g_t.peakSlewDegPerSec) {
+      g_t.peakSlewDegPerSec = rate;
+    }
+    if (!ventilation::withinSlewLimit(step, dtSec, kServoSlewLimitDegPerSec, kServoPulseStepDeg)) {
+      g_t.slewViolations++;
+    }
+  }
+  g_t.lastAngle = angle;
+  g_t.lastAngleUs = nowUs;
+}
+
+// Compares the DMA-sampled feedback published by Core 0 against the
+// command. A loaded servo legitimately trails a fast sweep, so anywhere
+// between the command and a model of the slowest healthy servo (the command
+// slew-limited to kServoLoadedDegPerSec) counts as zero error. Only reads a
+// shared float, so it costs the control loop nothing.
+void trackServoFeedback(float commanded, uint64_t nowUs) {
+  if (!kServoFeedbackEnabled) return;
+  const float maxStep = kServoLoadedDegPerSec * kControlPeriodMs / 1000.0f;
+  g_t.lagModelAngle += std::max(-maxStep, std::min(maxStep, commanded - g_t.lagModelAngle));
+
+  const float measured = g_sharedServoFeedbackDeg;
+  if (isnan(measured)) return;
+
+  const float lo = std::min(commanded, g_t.lagModelAngle);
+  const float hi = std::max(commanded, g_t.lagModelAngle);
+  const float err = measured < lo ? lo - measured : (measured > hi ? measured - hi : 0.0f);
+  g_t.trackSamples++;
+  g_t.trackErrAbsSum += err;
+  g_t.trackErrSqSum += err * err;
+  if (err > g_t.trackErrMax) {
+    g_t.trackErrMax = err;
+  }
+
+  if (err > kServoStallErrorDeg) {
+    if (g_t.trackErrSinceUs == 0) {
+      g_t.trackErrSinceUs = nowUs;
+    } else if (nowUs - g_t.trackErrSinceUs >= kServoStallMs * 1000ULL) {
+      g_t.servoStall = true;
+    }
+  } else {
+    g_t.trackErrSinceUs = 0;
+    g_t.servoStall = false;
+  }
+}
+
+// One tick of the flow channel: consume last tick's read (queued on
+// TaskI2c, so the control loop never waits on the bus), integrate it, and
+// queue the next. Integer-only.
+void sampleFlow(uint64_t nowUs, bool inhaling) {
+  FlowChannel& f = g_flow;
+  if (f.inFlight) {
+    if (!f.txn.done) return; // Bus busy; pick it up next tick
+    f.inFlight = false;
+
+    if (f.stale) {
+      f.stale = false; // Only the start command's outcome still matters
+      if (!f.started) f.started = f.txn.ok;
+    } else if (!f.started) {
+      f.started = f.txn.ok;
+    } else if (f.txn.ok && ventilation::sensirionCrc8(f.rx, 2) == f.rx[2]) {
+      const int16_t counts = static_cast<int16_t>((f.rx[0] << 8) | f.rx[1]);
+      f.flowUlPerSec = counts * kFlowUlPerSecPerPa / kFlowCountsPerPa;
+      if (inhaling && f.lastSampleUs != 0) {
+        // Capped, so a late or missed read cannot inflate the volume
+        const int64_t dtUs = std::min(static_cast<int64_t>(nowUs - f.lastSampleUs), kFlowMaxSampleGapUs);
+        f.inhaleVolumeUl += static_cast<int32_t>(f.flowUlPerSec * dtUs / 1000000);
+        f.breathSamples++;
+      }
+      f.lastSampleUs = nowUs;
+      f.samples++;
+      f.failures = 0;
+    } else {
+      f.errors++;
+      if (++f.failures >= kFlowMaxFailures) {
+        f.started = false;
+        f.failures = 0;
+      }
+    }
   }
-  if (spo2 < kSpo2MidThreshold) {
-    return kBpmMidSpo2;
+
+  f.txn.address = kFlowSensorAddress;
+  if (f.started) {
+    f.txn.tx = nullptr;
+    f.txn.txLen = 0;
+    f.txn.rx = f.rx;
+    f.txn.rxLen = sizeof(f.rx);
+  } else {
+    f.txn.tx = kFlowStartCmd;
+    f.txn.txLen = sizeof(kFlowStartCmd);
+    f.txn.rx = nullptr;
+    f.txn.rxLen = 0;
   }
-  return kBpmHighSpo2;
+  f.inFlight = i2cSubmit(&f.txn);
 }
 
-void recomputeCycle(int bpm) {
-  if (bpm <= 0) return;
-  g_t.cycleDurationMs = 60000UL / static_cast<uint32_t>(bpm);
+// Stop and (re)start: the next read starts a fresh integration instead of
+// spanning the whole stopped interval
+void resetFlowSampling() {
+  FlowChannel& f = g_flow;
+  f.lastSampleUs = 0;
+  f.inhaleVolumeUl = 0;
+  f.breathSamples = 0;
+  f.stale = f.inFlight;
+}
+
+// Breath boundary: closes the breath's volume integration and runs the
+// volume PID (see volume_control.h). Returns the measured tidal volume, or -1.
+int32_t updateVolumeControl() {
+  FlowChannel& f = g_flow;
+  const bool valid = f.breathSamples >= kFlowMinBreathSamples;
+  const int32_t tidalMl = f.inhaleVolumeUl / 1000;
+  f.inhaleVolumeUl = 0;
+  f.breathSamples = 0;
+  if (!valid) return -1; // Hold the current peak without data
+
+  ventilation::updateVolumePid(g_volume, kVolumePid, tidalMl);
+  return tidalMl;
+}
+
+void recordFlowCycles(uint32_t cycles) {
+  if (cycles > g_flow.cyclesMax) {
+    g_flow.cyclesMax = cycles;
+  }
+  if (cycles > kFlowBudgetCycles) {
+    g_flow.budgetOverruns++;
+  }
+}
+
+void resetBreathMetrics() {
+  g_t.breathInhaleUs = 0;
+  g_t.breathPeakAngle = kMinAngle;
+  g_t.breathSpo2Sum = 0.0f;
+  g_t.breathSpo2Ticks = 0;
+  g_t.breathHrSum = 0.0f;
+  g_t.breathHrTicks = 0;
+}
+
+// Every tick: constant work, so finishing a breath never scans anything
+void accumulateBreathMetrics(float angle, bool inhaling, uint64_t nowUs) {
+  if (!inhaling && g_t.breathInhaleUs == 0) {
+    g_t.breathInhaleUs = static_cast<uint32_t>(nowUs - g_t.cycleStartUs);
+  }
+  if (angle > g_t.breathPeakAngle) {
+    g_t.breathPeakAngle = angle;
+  }
+  if (g_t.sensorOk && !isnan(g_t.spo2)) {
+    g_t.breathSpo2Sum += g_t.spo2;
+    g_t.breathSpo2Ticks++;
+  }
+  // Manual mode simulates SpO2 only, so the heart rate would be the last
+  // sensor reading rather than a measurement
+  if (g_t.sensorOk && !g_manualMode && !isnan(g_t.heartRate)) {
+    g_t.breathHrSum += g_t.heartRate;
+    g_t.breathHrTicks++;
+  }
+}
+
+// Cycle boundary, before applyPendingCycle() so the target is the one this
+// breath ran against
+void finishBreath(uint64_t nowUs, int32_t tidalMl) {
+  BreathRecord r;
+  r.startUs = g_t.cycleStartUs;
+  r.durationUs = static_cast<uint32_t>(nowUs - g_t.cycleStartUs);
+  r.inhaleUs = g_t.breathInhaleUs;
+  r.timingErrorUs = static_cast<int32_t>(r.durationUs - g_t.cycle.durationMs * 1000UL);
+  r.peakAngle = g_t.breathPeakAngle;
+  r.spo2 = g_t.breathSpo2Ticks > 0 ? g_t.breathSpo2Sum / g_t.breathSpo2Ticks : NAN;
+  r.heartRate = g_t.breathHrTicks > 0 ? g_t.breathHrSum / g_t.breathHrTicks : NAN;
+  r.tidalMl = static_cast<int16_t>(std::max<int32_t>(-1, std::min<int32_t>(INT16_MAX, tidalMl)));
+  r.targetBpm = static_cast<uint8_t>(60000UL / g_t.cycle.durationMs);
+
+  portENTER_CRITICAL(&g_breathLogMux);
+  r.seq = g_breathLogNextSeq++;
+  g_breathLog[r.seq % kBreathLogSize] = r;
+  portEXIT_CRITICAL(&g_breathLogMux);
+  resetBreathMetrics();
 }
 
 void updateBreathing() {
+  if (g_restartCycleRequest) {
+    g_restartCycleRequest = false;
+    g_t.cycleStartUs = 0;
+  }
   if (!g_ventilatorRunning) {
-    g_servo.write(kMinAngle);
+    applyPendingCycle();
+    g_t.lastAngleUs = 0;
+    g_t.lagModelAngle = kMinAngle;
+    g_t.trackErrSinceUs = 0;
+    g_t.servoStall = false;
+    resetFlowSampling();
+    resetBreathMetrics(); // A breath cut short by a stop is not recorded
+    writeServoAngle(kMinAngle);
     return;
   }
 
-  const uint32_t now = millis();
+  const uint64_t nowUs = timebaseUs();
   
-  if (g_t.cycleStartMs == 0) {
-    g_t.cycleStartMs = now;
+  if (g_t.cycleStartUs == 0) {
+    applyPendingCycle();
+    resetFlowSampling();
+    resetBreathMetrics();
+    g_t.cycleStartUs = nowUs;
+    markBootPhase(kBootFirstBreath);
   }
 
-  uint32_t elapsed = now - g_t.cycleStartMs;
+  uint32_t elapsed = static_cast<uint32_t>((nowUs - g_t.cycleStartUs) / 1000);
   
-  if (elapsed >= g_t.cycleDurationMs) {
-    g_t.cycleStartMs = now;
+  const uint32_t flowStartCycles = ESP.getCycleCount();
+  if (elapsed >= g_t.cycle.durationMs) {
+    // Exhale complete: servo is back at kMinAngle, safe to switch rate and depth
+    const int32_t tidalMl = kFlowSensorEnabled ? updateVolumeControl() : -1;
+    finishBreath(nowUs, tidalMl);
+    applyPendingCycle();
+    g_t.cycleStartUs = nowUs;
     elapsed = 0;
   }
 
-  const uint32_t inhaleDuration = static_cast<uint32_t>(g_t.cycleDurationMs * kInhaleFraction);
-  int targetAngle = kMinAngle;
+  const uint32_t inhaleDuration = static_cast<uint32_t>(g_t.cycle.durationMs * kInhaleFraction);
+  if (kFlowSensorEnabled) {
+    sampleFlow(nowUs, elapsed < inhaleDuration);
+    recordFlowCycles(ESP.getCycleCount() - flowStartCycles);
+  }
 
-  // Sine Easing: -0.5 * (cos(PI*x) - 1)
-  auto easeInOutSine = [](float t) -> float {
-      return -0.5f * (cos(PI * t) - 1.0f);
-  };
+  const float peakAngle = static_cast<float>(g_volume.peakQ8) / 256.0f;
+  const float targetAngle =
+      ventilation::trajectoryAngle(elapsed, g_t.cycle.durationMs, kInhaleFraction, kMinAngle, peakAngle);
+  trackServoSlew(targetAngle, nowUs);
+  trackServoFeedback(targetAngle, nowUs);
+  accumulateBreathMetrics(targetAngle, elapsed < inhaleDuration, nowUs);
+  writeServoAngle(targetAngle);
+}
 
-  if (elapsed < inhaleDuration) {
-    float t = static_cast<float>(elapsed) / static_cast<float>(inhaleDuration);
-    targetAngle = kMinAngle + static_cast<int>((kMaxAngle - kMinAngle) * easeInOutSine(t));
-  } else {
-    uint32_t exhaleElapsed = elapsed - inhaleDuration;
-    uint32_t exhaleDuration = g_t.cycleDurationMs - inhaleDuration;
-    float t = static_cast<float>(exhaleElapsed) / static_cast<float>(exhaleDuration);
-    targetAngle = kMaxAngle - static_cast<int>((kMaxAngle - kMinAngle) * easeInOutSine(t));
+void saveSettings() {
+  SavedSettings s = {};
+  s.version = kSettingsVersion;
+  s.running = g_ventilatorRunning;
+  s.targetBpm = static_cast<int16_t>(g_sharedTargetBpm);
+  g_settingsPrefs.putBytes("s", &s, sizeof(s));
+  g_savedTargetBpm = s.targetBpm;
+}
+
+// Before the tasks start. A missing or old-format blob keeps the defaults.
+void loadSettings() {
+  g_settingsPrefs.begin("settings", false);
+  SavedSettings s = {};
+  if (g_settingsPrefs.getBytes("s", &s, sizeof(s)) != sizeof(s) || s.version != kSettingsVersion) {
+    return;
+  }
+  if (s.targetBpm >= 5 && s.targetBpm <= 40) {
+    g_sharedTargetBpm = s.targetBpm;
+    g_savedTargetBpm = s.targetBpm;
+  }
+  g_ventilatorRunning = s.running;
+  Serial.println(s.running ? "Restored settings: ventilating" : "Restored settings: stopped");
+}
+
+// From loop(). An NVS write disables the flash cache on both cores and so
+// stalls TaskControl (see flushAlarmJournal). Handlers therefore only mark
+// the settings dirty, and this writes them at most once per kSettingsFlushMs.
+// Sensor-driven BPM changes are folded in at most once a minute. A change
+// made less than kSettingsFlushMs before power loss is not kept.
+void flushSettings() {
+  static uint32_t lastAutoMs = 0;
+  static uint32_t lastWriteMs = 0;
+  const uint32_t now = millis();
+  if (g_sharedTargetBpm != g_savedTargetBpm && now - lastAutoMs >= kSettingsAutoBpmSaveMs) {
+    lastAutoMs = now;
+    g_settingsDirty = true;
+  }
+  if (!g_settingsDirty || now - lastWriteMs < kSettingsFlushMs) return;
+  lastWriteMs = now;
+  g_settingsDirty = false;
+
+  const uint32_t startUs = micros();
+  saveSettings();
+  const uint32_t elapsedUs = micros() - startUs;
+  if (elapsedUs > g_settingsSaveUsMax) {
+    g_settingsSaveUsMax = elapsedUs;
   }
-  g_servo.write(targetAngle);
 }
 
 void handleSetZero() {
+  // TaskControl owns the servo and parks it on its next tick
   g_ventilatorRunning = false;
-  g_servo.write(kMinAngle);
+  g_settingsDirty = true;
   g_server.send(200, "text/plain", "OK: Position Zero Set");
 }
 
 void handleStart() {
+  // Reset cycle timing so it starts fresh 0 -> 90 (TaskControl owns g_t)
+  g_restartCycleRequest = true;
   g_ventilatorRunning = true;
-  // Reset cycle timing so it starts fresh 0 -> 90
-  g_t.cycleStartMs = 0; 
+  g_settingsDirty = true;
   g_server.send(200, "text/plain", "OK: Ventilator Started");
 }
 
@@ -195,6 +1057,7 @@ void handleSetSpo2() {
   if (g_server.hasArg("val")) {
     g_manualSpo2 = g_server.arg("val").toFloat();
     g_manualMode = true;
+    publishSample(g_sharedSpo2SampleUs);
     g_server.send(200, "text/plain", "OK: Manual SpO2 Set");
   } else {
     g_server.send(400, "text/plain", "Bad Request");
@@ -225,9 +1088,79 @@ void handleSetBpm() {
   }
   
   g_sharedTargetBpm = newBpm;
+  g_bpmSeedRequest = newBpm; // TaskControl owns g_bpmCtl
+  g_settingsDirty = true;
   g_server.send(200, "text/plain", "OK: BPM Set to " + String(newBpm));
 }
 
+LogView logView() {
+  portENTER_CRITICAL(&g_dataLogMux);
+  const size_t head = g_dataLogHead;
+  const size_t count = g_dataLogCount;
+  const LogView v = {
+    head, count,
+    count > 0 ? g_dataLog[(head + kMaxDataPoints - count) % kMaxDataPoints].timestampUs : 0,
+    count > 0 ? g_dataLog[(head + kMaxDataPoints - 1) % kMaxDataPoints].timestampUs : 0,
+  };
+  portEXIT_CRITICAL(&g_dataLogMux);
+  return v;
+}
+
+// Physical slot of the i-th oldest entry
+size_t logSlot(const LogView& v, size_t i) {
+  return ventilation::ringSlot(v.head, v.count, kMaxDataPoints, i);
+}
+
+PatientDataPoint readLogSlot(size_t slot) {
+  portENTER_CRITICAL(&g_dataLogMux);
+  const PatientDataPoint p = g_dataLog[slot];
+  portEXIT_CRITICAL(&g_dataLogMux);
+  return p;
+}
+
+PatientDataPoint readLogRow(const LogView& v, size_t i) {
+  return readLogSlot(logSlot(v, i));
+}
+
+// First logical index whose timestamp is at or after tsUs, or v.count if
+// none (the 64-bit timebase never wraps, so stamps ascend through the ring)
+size_t logLowerBound(const LogView& v, uint64_t tsUs) {
+  return ventilation::ringLowerBound(v.count, tsUs,
+                                     [&](size_t i) { return readLogRow(v, i).timestampUs; });
+}
+
+// Absolute local time once the wall clock is anchored, else "N min ago"
+String formatLogTimestamp(uint64_t tsUs, uint64_t nowUs) {
+  if (!g_wallClockSet) {
+    return String(static_cast<uint32_t>((nowUs - tsUs) / 60000000ULL)) + " min ago";
+  }
+  const time_t secs = static_cast<time_t>(displayMs(tsUs) / 1000) - static_cast<time_t>(g_tzOffsetMin) * 60;
+  struct tm tmLocal;
+  gmtime_r(&secs, &tmLocal);
+  char buf[24];
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmLocal);
+  return String(buf);
+}
+
+float statValue(const PatientDataPoint& p, size_t metric);
+
+// Largest-Triangle-Three-Buckets downsampling for /get_data?points=N, see
+// log_ring.h. Rows are plotted against time, with every metric normalised to
+// its /stats binning range so the triangle area sums across all of them.
+using LttbPoint = ventilation::LttbPoint<kStatMetricCount>;
+
+LttbPoint lttbPoint(const LogView& v, size_t i, uint64_t originUs) {
+  const PatientDataPoint p = readLogRow(v, i);
+  LttbPoint pt;
+  pt.x = static_cast<float>(p.timestampUs - originUs) / 1e6f; // Seconds since originUs
+  for (size_t m = 0; m < kStatMetricCount; m++) {
+    pt.y[m] = (statValue(p, m) - kStatBinning[m].lo) / (kStatBins * kStatBinning[m].binWidth);
+  }
+  return pt;
+}
+
+// GET /get_data?duration=<1h|6h|12h|all>[&points=N]
+// With points, returns at most N rows chosen by LTTB instead of every row.
 void handleGetData() {
   if (!g_server.hasArg("duration")) {
     g_server.send(400, "text/plain", "Bad Request: Missing duration parameter");
@@ -235,104 +1168,683 @@ void handleGetData() {
   }
   
   String durStr = g_server.arg("duration");
-  uint32_t durationMin = 0;
+  uint32_t durationMin = 0; // 0 = all
   
   if (durStr == "1h") durationMin = 60;
   else if (durStr == "6h") durationMin = 360;
   else if (durStr == "12h") durationMin = 720;
-  else if (durStr == "all") durationMin = 999999;
+  else if (durStr == "all") durationMin = 0;
   else {
     g_server.send(400, "text/plain", "Bad Request: Invalid duration");
     return;
   }
+
+  size_t points = 0; // 0 = every row
+  if (g_server.hasArg("points")) {
+    const long n = g_server.arg("points").toInt();
+    if (n < 3) {
+      g_server.send(400, "text/plain", "Bad Request: points must be at least 3");
+      return;
+    }
+    points = static_cast<size_t>(n);
+  }
   
   // Generate CSV data (client will convert to PDF using JavaScript library)
   String csv = "Timestamp,SpO2 (%),Heart Rate (BPM),Temperature (°F),Ventilation Rate (BPM)\\n";
   
-  uint32_t nowMs = millis();
-  uint32_t cutoffMs = nowMs - (durationMin * 60000);
+  const uint64_t nowUs = timebaseUs();
+  const uint64_t windowUs = static_cast<uint64_t>(durationMin) * 60000000ULL;
+  const LogView view = logView();
+  // Binary search for the first entry in range, then walk only the k matches
+  const size_t first = (durationMin == 0 || windowUs >= nowUs) ? 0 : logLowerBound(view, nowUs - windowUs);
   
-  size_t count = 0;
-  for (size_t i = 0; i < g_dataLogCount; i++) {
-    size_t idx = (g_dataLogHead + kMaxDataPoints - g_dataLogCount + i) % kMaxDataPoints;
-    if (durationMin < 999999 && g_dataLog[idx].timestamp < cutoffMs) {
-      continue;
-    }
+  auto appendRow = [&](size_t i) {
+    const PatientDataPoint p = readLogRow(view, i);
     
-    // Convert timestamp to readable format (minutes ago)
-    uint32_t ageMs = nowMs - g_dataLog[idx].timestamp;
-    uint32_t minAgo = ageMs / 60000;
-    
-    csv += String(minAgo) + " min ago,";
-    csv += String(g_dataLog[idx].spo2, 1) + ",";
-    csv += String(g_dataLog[idx].heartRate, 1) + ",";
-    csv += String(g_dataLog[idx].tempF, 1) + ",";
-    csv += String(g_dataLog[idx].targetBpm);
+    csv += formatLogTimestamp(p.timestampUs, nowUs) + ",";
+    csv += String(p.spo2, 1) + ",";
+    csv += String(p.heartRate, 1) + ",";
+    csv += String(p.tempF, 1) + ",";
+    csv += String(p.targetBpm);
     csv += "\\n";
-    count++;
+  };
+  if (points > 0 && first < view.count) {
+    const uint64_t originUs = readLogRow(view, first).timestampUs;
+    ventilation::lttbDownsample<kStatMetricCount>(
+        first, view.count, points, [&](size_t i) { return lttbPoint(view, i, originUs); }, appendRow);
+  } else {
+    for (size_t i = first; i < view.count; i++) appendRow(i);
   }
   
   g_server.send(200, "text/csv", csv);
 }
 
-void checkAlarms() {
-  uint32_t now = millis();
-  if (now - g_lastAlarmCheckMs < 1000) return; // Check every second
-  g_lastAlarmCheckMs = now;
-  
-  bool shouldAlarm = false;
-  
-  // Check temperature (convert from C to F)
-  if (!isnan(g_t.tempC)) {
-    float tempF = g_t.tempC * 9.0f / 5.0f + 32.0f;
-    if (tempF < kAlarmTempThresholdF) {
-      shouldAlarm = true;
-    }
-  }
-  
-  // Check SpO2
-  if (!isnan(g_t.spo2) && g_t.spo2 < kAlarmSpo2Threshold) {
-    shouldAlarm = true;
+// Reads the stamp first: a sample published in between must not make the age negative
+float sampleAgeMs(const uint64_t& sensorUs) {
+  const uint64_t at = readShared(sensorUs);
+  return static_cast<float>(timebaseUs() - at) / 1000.0f;
+}
+
+// NAN means no data; every comparison against NAN is false, so the
+// condition reads as absent without a separate check.
+void gatherAlarmSignals(float* signals) {
+  signals[static_cast<size_t>(AlarmSignal::Spo2)] = g_t.spo2;
+  // Manual mode simulates SpO2 only; the last sensor HR is stale, as is its age
+  signals[static_cast<size_t>(AlarmSignal::HeartRate)] = g_manualMode ? NAN : g_t.heartRate;
+  signals[static_cast<size_t>(AlarmSignal::Spo2AgeMs)] =
+      g_manualMode ? NAN : sampleAgeMs(g_sharedSpo2SampleUs);
+  signals[static_cast<size_t>(AlarmSignal::TempF)] =
+      isnan(g_t.tempC) ? NAN : (g_t.tempC * 9.0f / 5.0f + 32.0f);
+  signals[static_cast<size_t>(AlarmSignal::SensorOk)] = g_t.sensorOk ? 1.0f : 0.0f;
+  // The probe is read in manual mode too
+  signals[static_cast<size_t>(AlarmSignal::TempAgeMs)] = sampleAgeMs(g_sharedTempSampleUs);
+  signals[static_cast<size_t>(AlarmSignal::ServoStall)] = g_t.servoStall ? 1.0f : 0.0f;
+  // sensor_lost already covers a missing sensor
+  signals[static_cast<size_t>(AlarmSignal::SignalQuality)] =
+      (g_manualMode || !g_t.sensorOk) ? 100.0f : static_cast<float>(g_t.sqi);
+}
+
+AlarmEvent* journalFind(uint32_t seq) {
+  if (seq == 0 || seq >= g_alarmJournalNextSeq) return nullptr;
+  AlarmEvent& e = g_alarmJournal[seq % kAlarmJournalSize];
+  return e.seq == seq ? &e : nullptr;
+}
+
+// Journal times are on the client-visible clock, fixed per event at onset
+uint64_t journalStampMs(bool wallClock, uint64_t nowUs) {
+  return wallClock ? displayMs(nowUs) : nowUs / 1000;
+}
+
+void journalOnset(size_t rule, float value, uint64_t nowUs) {
+  portENTER_CRITICAL(&g_alarmJournalMux);
+  const uint32_t seq = g_alarmJournalNextSeq++;
+  const size_t slot = seq % kAlarmJournalSize;
+  AlarmEvent& e = g_alarmJournal[slot];
+  e.seq = seq;
+  e.boot = g_bootCount;
+  e.rule = static_cast<uint8_t>(rule);
+  e.acked = false;
+  e.value = value;
+  e.wallClock = g_wallClockSet;
+  e.onsetMs = journalStampMs(e.wallClock, nowUs);
+  e.clearMs = 0;
+  e.ackMs = 0;
+  g_alarmJournalDirty |= 1ULL << slot;
+  portEXIT_CRITICAL(&g_alarmJournalMux);
+  g_alarmOpenSeq[rule] = seq;
+}
+
+void journalClear(size_t rule, uint64_t nowUs) {
+  portENTER_CRITICAL(&g_alarmJournalMux);
+  AlarmEvent* e = journalFind(g_alarmOpenSeq[rule]);
+  if (e != nullptr) {
+    e->clearMs = journalStampMs(e->wallClock, nowUs);
+    g_alarmJournalDirty |= 1ULL << (e->seq % kAlarmJournalSize);
   }
-  
-  if (shouldAlarm && !g_alarmActive) {
-    g_alarmActive = true;
-    digitalWrite(kBuzzerPin, HIGH); // Activate buzzer
-  } else if (!shouldAlarm && g_alarmActive) {
-    g_alarmActive = false;
-    digitalWrite(kBuzzerPin, LOW); // Deactivate buzzer
+  portEXIT_CRITICAL(&g_alarmJournalMux);
+  g_alarmOpenSeq[rule] = 0;
+}
+
+void journalAck(size_t rule, uint64_t nowUs) {
+  portENTER_CRITICAL(&g_alarmJournalMux);
+  AlarmEvent* e = journalFind(g_alarmOpenSeq[rule]);
+  if (e != nullptr && !e->acked) {
+    e->acked = true;
+    e->ackMs = journalStampMs(e->wallClock, nowUs);
+    g_alarmJournalDirty |= 1ULL << (e->seq % kAlarmJournalSize);
   }
-  
-  // Beep pattern when alarm is active
-  if (g_alarmActive) {
-    static uint32_t lastBeepMs = 0;
-    if (now - lastBeepMs > 500) { // Toggle every 500ms
-      lastBeepMs = now;
-      digitalWrite(kBuzzerPin, !digitalRead(kBuzzerPin));
-    }
+  portEXIT_CRITICAL(&g_alarmJournalMux);
+}
+
+// --------------------------------------------------------------------------
+// BUZZER SEQUENCER
+// IEC 60601-1-8 style bursts played on a dedicated LEDC channel. Each step is
+// timed by a one-shot esp_timer, whose callback runs in the esp_timer task on
+// Core 0, so cadence is exact and independent of the control loop.
+// --------------------------------------------------------------------------
+struct ToneStep {
+  uint16_t freqHz;     // 0 = silent
+  uint16_t durationMs;
+};
+
+// High: 10 pulses (3+2, 3+2), then 2.5 s inter-burst
+constexpr ToneStep kHighPriorityTones[] = {
+  {880, 150}, {0, 100}, {880, 150}, {0, 100}, {880, 150}, {0, 350}, {880, 150}, {0, 100}, {880, 150}, {0, 1000},
+  {880, 150}, {0, 100}, {880, 150}, {0, 100}, {880, 150}, {0, 350}, {880, 150}, {0, 100}, {880, 150}, {0, 2500},
+};
+// Medium: 3 pulses, then 5 s inter-burst
+constexpr ToneStep kMediumPriorityTones[] = {
+  {660, 200}, {0, 100}, {660, 200}, {0, 100}, {660, 200}, {0, 5000},
+};
+// Low: 2 pulses, then 16 s inter-burst
+constexpr ToneStep kLowPriorityTones[] = {
+  {440, 200}, {0, 100}, {440, 200}, {0, 16000},
+};
+
+struct TonePattern {
+  const ToneStep* steps;
+  size_t count;
+};
+
+template <size_t N>
+constexpr TonePattern makePattern(const ToneStep (&steps)[N]) {
+  return {steps, N};
+}
+
+TonePattern patternFor(AlarmPriority p) {
+  switch (p) {
+    case AlarmPriority::High:   return makePattern(kHighPriorityTones);
+    case AlarmPriority::Medium: return makePattern(kMediumPriorityTones);
+    case AlarmPriority::Low:    return makePattern(kLowPriorityTones);
+    default:                    return {nullptr, 0};
   }
 }
 
-void logPatientData() {
-  uint32_t now = millis();
-  if (now - g_lastDataLogMs < 60000) return; // Log every minute
-  g_lastDataLogMs = now;
-  
-  PatientDataPoint& point = g_dataLog[g_dataLogHead];
-  point.timestamp = now;
-  point.spo2 = g_t.spo2;
-  point.heartRate = g_t.heartRate;
-  point.tempF = isnan(g_t.tempC) ? NAN : (g_t.tempC * 9.0f / 5.0f + 32.0f);
-  point.targetBpm = g_t.targetBpm;
-  
-  g_dataLogHead = (g_dataLogHead + 1) % kMaxDataPoints;
-  if (g_dataLogCount < kMaxDataPoints) {
-    g_dataLogCount++;
+esp_timer_handle_t g_buzzerTimer = nullptr;
+volatile AlarmPriority g_buzzerPriority = AlarmPriority::None; // Requested by TaskControl
+AlarmPriority g_buzzerPlaying = AlarmPriority::None;           // Owned by the timer callback
+size_t g_buzzerStep = 0;
+
+// Only place that touches the LEDC channel
+void buzzerTimerCallback(void* arg) {
+  const AlarmPriority want = g_buzzerPriority;
+  if (want != g_buzzerPlaying) {
+    g_buzzerPlaying = want;
+    g_buzzerStep = 0;
+  } else {
+    g_buzzerStep++;
+  }
+
+  const TonePattern pattern = patternFor(want);
+  if (pattern.count == 0) {
+    ledcWriteTone(kBuzzerLedcChannel, 0);
+    return; // Idle until the next request
   }
+  g_buzzerStep %= pattern.count;
+
+  const ToneStep& step = pattern.steps[g_buzzerStep];
+  ledcWriteTone(kBuzzerLedcChannel, step.freqHz);
+  esp_timer_start_once(g_buzzerTimer, static_cast<uint64_t>(step.durationMs) * 1000ULL);
 }
 
-void handleRoot() {
-  const char* html = R"raw(
+void initBuzzer() {
+  ledcSetup(kBuzzerLedcChannel, 1000, kBuzzerLedcResolution);
+  ledcAttachPin(kBuzzerPin, kBuzzerLedcChannel);
+  ledcWrite(kBuzzerLedcChannel, 0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = buzzerTimerCallback;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "buzzer";
+  esp_timer_create(&args, &g_buzzerTimer);
+}
+
+// Restarts the sequence right away so escalation doesn't wait out a long
+// inter-burst gap. The retry covers the callback re-arming between our
+// stop and start.
+void buzzerSetPriority(AlarmPriority p) {
+  if (p == g_buzzerPriority || g_buzzerTimer == nullptr) return;
+  g_buzzerPriority = p;
+  esp_timer_stop(g_buzzerTimer);
+  if (esp_timer_start_once(g_buzzerTimer, 1) != ESP_OK) {
+    esp_timer_stop(g_buzzerTimer);
+    esp_timer_start_once(g_buzzerTimer, 1);
+  }
+}
+
+void updateBuzzer() {
+  // Sound only while an active alarm is unacknowledged
+  buzzerSetPriority(g_alarmActive && !g_alarmAcked ? g_alarmPriority : AlarmPriority::None);
+}
+
+// Event-driven: runs the rules when a new sample arrived, the servo stall
+// state changed, an ack came in, or a delay/latch timer is running. A slow
+// housekeeping pass catches time-derived signals such as data age.
+void checkAlarms() {
+  const uint64_t nowUs = timebaseUs();
+  const uint32_t seq = g_sharedSampleSeq;
+  const bool newSample = seq != g_alarmSeenSeq;
+  const bool stallEdge = g_t.servoStall != g_alarmSeenStall;
+  const bool ackRequest = g_alarmAckRequest;
+
+  const bool housekeeping = nowUs - g_alarmLastEvalUs >= kAlarmHousekeepingMs * 1000ULL;
+
+  if (newSample || stallEdge || ackRequest || g_alarmTimersPending || housekeeping) {
+    g_alarmSeenSeq = seq;
+    g_alarmSeenStall = g_t.servoStall;
+
+    if (ackRequest) {
+      g_alarmAckRequest = false;
+      for (size_t i = 0; i < kAlarmCount; i++) {
+        if (g_alarms[i].active && !g_alarms[i].acked) {
+          g_alarms[i].acked = true;
+          journalAck(i, nowUs);
+        }
+      }
+    }
+
+    float signals[static_cast<size_t>(AlarmSignal::Count)];
+    gatherAlarmSignals(signals);
+
+    ventilation::AlarmSummary sum;
+    const uint32_t startCycles = ESP.getCycleCount();
+    ventilation::evaluateRules<kAlarmRules>(g_alarms, signals, nowUs, sum,
+        [nowUs](size_t rule, bool raised, float value) {
+          if (raised) {
+            journalOnset(rule, value, nowUs);
+          } else {
+            journalClear(rule, nowUs);
+          }
+        });
+    const uint32_t cycles = ESP.getCycleCount() - startCycles;
+    if (cycles > g_alarmEvalCyclesMax) {
+      g_alarmEvalCyclesMax = cycles;
+    }
+
+    g_alarmActive = sum.active;
+    g_alarmAcked = sum.active && sum.acked;
+    g_alarmPriority = sum.priority;
+    g_alarmTimersPending = sum.pending;
+    g_alarmLastEvalUs = nowUs;
+
+    if (newSample && sum.anyFlipped) {
+      g_alarmLatencyUsLast = static_cast<uint32_t>(timebaseUs() - readShared(g_sharedSampleUs));
+      if (g_alarmLatencyUsLast > g_alarmLatencyUsMax) {
+        g_alarmLatencyUsMax = g_alarmLatencyUsLast;
+      }
+    }
+  }
+
+  updateBuzzer();
+}
+
+// Writes dirty journal slots to NVS, one small blob per slot, from loop().
+// That keeps the NVS code off the alarm path, but not its cost: a flash
+// write or erase disables the flash cache on both cores, so TaskControl
+// stalls for the duration whenever it runs code or reads constants from
+// flash. Writes are therefore batched (every kAlarmJournalFlushMs) and
+// capped at kAlarmJournalFlushMaxSlots per flush, and the longest flush is
+// reported as journal_flush_us_max next to control_jitter_max_us.
+void flushAlarmJournal() {
+  static uint32_t lastFlushMs = 0;
+  const uint32_t now = millis();
+  if (now - lastFlushMs < kAlarmJournalFlushMs) return;
+  lastFlushMs = now;
+
+  // Take at most kAlarmJournalFlushMaxSlots dirty slots, oldest event first.
+  // The slot after the newest event holds the oldest one, so walking up
+  // from nextSeq's slot visits the ring in seq order, across the wrap.
+  portENTER_CRITICAL(&g_alarmJournalMux);
+  uint64_t dirty = g_alarmJournalDirty;
+  const uint32_t nextSeq = g_alarmJournalNextSeq;
+  for (size_t n = 0, k = 0; k < kAlarmJournalSize; k++) {
+    const size_t slot = (nextSeq + k) % kAlarmJournalSize;
+    if ((dirty & (1ULL << slot)) == 0) continue;
+    if (n++ >= kAlarmJournalFlushMaxSlots) dirty &= ~(1ULL << slot);
+  }
+  g_alarmJournalDirty &= ~dirty;
+  portEXIT_CRITICAL(&g_alarmJournalMux);
+  if (dirty == 0) return;
+
+  const uint32_t startUs = micros();
+  char key[8];
+  for (size_t slot = 0; slot < kAlarmJournalSize; slot++) {
+    if ((dirty & (1ULL << slot)) == 0) continue;
+    AlarmEvent e;
+    portENTER_CRITICAL(&g_alarmJournalMux);
+    e = g_alarmJournal[slot];
+    portEXIT_CRITICAL(&g_alarmJournalMux);
+    snprintf(key, sizeof(key), "e%u", static_cast<unsigned>(slot));
+    g_prefs.putBytes(key, &e, sizeof(e));
+  }
+  g_prefs.putUInt("next", nextSeq);
+  const uint32_t elapsedUs = micros() - startUs;
+  if (elapsedUs > g_alarmJournalFlushUsMax) {
+    g_alarmJournalFlushUsMax = elapsedUs;
+  }
+}
+
+void loadAlarmJournal() {
+  g_prefs.begin("alarmlog", false);
+  g_bootCount = static_cast<uint16_t>(g_prefs.getUInt("boot", 0) + 1);
+  g_prefs.putUInt("boot", g_bootCount);
+  g_alarmJournalNextSeq = g_prefs.getUInt("next", 1);
+
+  char key[8];
+  for (size_t slot = 0; slot < kAlarmJournalSize; slot++) {
+    snprintf(key, sizeof(key), "e%u", static_cast<unsigned>(slot));
+    AlarmEvent& e = g_alarmJournal[slot];
+    if (g_prefs.getBytes(key, &e, sizeof(AlarmEvent)) != sizeof(AlarmEvent)) {
+      e = AlarmEvent{};
+    } else if (e.seq != 0 && e.clearMs == 0) {
+      // Still open when the previous boot ended; its clear was never seen
+      e.clearMs = kJournalUnterminated;
+      g_alarmJournalDirty |= 1ULL << slot;
+    }
+  }
+}
+
+// GET /alarms?since=<seq>&limit=<n>
+// Oldest-first events with seq > since. Pass the returned "next" as since
+// to fetch the following page.
+void handleAlarms() {
+  uint32_t since = 0;
+  size_t limit = kAlarmQueryDefaultLimit;
+  if (g_server.hasArg("since")) {
+    since = static_cast<uint32_t>(g_server.arg("since").toInt());
+  }
+  if (g_server.hasArg("limit")) {
+    const long l = g_server.arg("limit").toInt();
+    if (l < 1 || l > static_cast<long>(kAlarmJournalSize)) {
+      g_server.send(400, "text/plain", "Bad Request: limit must be between 1 and 64");
+      return;
+    }
+    limit = static_cast<size_t>(l);
+  }
+
+  const uint32_t nextSeq = g_alarmJournalNextSeq;
+  const uint32_t oldest = nextSeq > kAlarmJournalSize ? nextSeq - kAlarmJournalSize : 1;
+  uint32_t seq = since + 1 > oldest ? since + 1 : oldest;
+
+  String json;
+  json.reserve(96 + limit * 140);
+  json += "{\"boot\":";
+  json += String(g_bootCount);
+  json += ",\"events\":[";
+  size_t count = 0;
+  uint32_t last = since;
+  for (; seq < nextSeq && count < limit; seq++) {
+    AlarmEvent e;
+    portENTER_CRITICAL(&g_alarmJournalMux);
+    e = g_alarmJournal[seq % kAlarmJournalSize];
+    portEXIT_CRITICAL(&g_alarmJournalMux);
+    if (e.seq != seq || e.rule >= kAlarmCount) continue;
+
+    if (count > 0) json += ",";
+    json += "{\"seq\":";
+    json += String(e.seq);
+    json += ",\"boot\":";
+    json += String(e.boot);
+    json += ",\"rule\":\"";
+    json += kAlarmRules[e.rule].name;
+    json += "\",\"priority\":";
+    json += String(static_cast<int>(kAlarmRules[e.rule].priority));
+    json += ",\"value\":";
+    json += isnan(e.value) ? String("null") : String(e.value, 1);
+    json += ",\"onset_ms\":";
+    json += u64ToString(e.onsetMs);
+    json += ",\"clear_ms\":";
+    json += (e.clearMs == 0 || e.clearMs == kJournalUnterminated) ? String("null") : u64ToString(e.clearMs);
+    json += ",\"unterminated\":";
+    json += (e.clearMs == kJournalUnterminated ? "true" : "false");
+    json += ",\"acked\":";
+    json += (e.acked ? "true" : "false");
+    json += ",\"ack_ms\":";
+    json += e.ackMs == 0 ? String("null") : u64ToString(e.ackMs);
+    json += ",\"wall_clock\":";
+    json += (e.wallClock ? "true" : "false");
+    json += "}";
+    count++;
+    last = seq;
+  }
+  json += "],\"next\":";
+  json += String(last);
+  json += ",\"more\":";
+  json += (seq < nextSeq ? "true" : "false");
+  json += "}";
+  g_server.send(200, "application/json", json);
+}
+
+// GET /breaths?since=<seq>&limit=<n>
+// Per-breath records, oldest first, paged like /alarms. Lost on reboot.
+void handleBreaths() {
+  uint32_t since = 0;
+  size_t limit = kBreathQueryDefaultLimit;
+  if (g_server.hasArg("since")) {
+    since = static_cast<uint32_t>(g_server.arg("since").toInt());
+  }
+  if (g_server.hasArg("limit")) {
+    const long l = g_server.arg("limit").toInt();
+    if (l < 1 || l > static_cast<long>(kBreathLogSize)) {
+      g_server.send(400, "text/plain", "Bad Request: limit must be between 1 and 128");
+      return;
+    }
+    limit = static_cast<size_t>(l);
+  }
+
+  portENTER_CRITICAL(&g_breathLogMux);
+  const uint32_t nextSeq = g_breathLogNextSeq;
+  portEXIT_CRITICAL(&g_breathLogMux);
+  const uint32_t oldest = nextSeq > kBreathLogSize ? nextSeq - kBreathLogSize : 1;
+  uint32_t seq = since + 1 > oldest ? since + 1 : oldest;
+
+  String json;
+  json.reserve(64 + limit * 200);
+  json += "{\"wall_clock\":";
+  json += (g_wallClockSet ? "true" : "false");
+  json += ",\"breaths\":[";
+  size_t count = 0;
+  uint32_t last = since;
+  for (; seq < nextSeq && count < limit; seq++) {
+    BreathRecord r;
+    portENTER_CRITICAL(&g_breathLogMux);
+    r = g_breathLog[seq % kBreathLogSize];
+    portEXIT_CRITICAL(&g_breathLogMux);
+    if (r.seq != seq) continue; // Overwritten while paging
+
+    if (count > 0) json += ",";
+    json += "{\"seq\":";
+    json += String(r.seq);
+    json += ",\"start_ms\":";
+    json += u64ToString(displayMs(r.startUs));
+    json += ",\"duration_us\":";
+    json += String(r.durationUs);
+    json += ",\"inhale_us\":";
+    json += String(r.inhaleUs);
+    json += ",\"timing_error_us\":";
+    json += String(r.timingErrorUs);
+    json += ",\"target_bpm\":";
+    json += String(r.targetBpm);
+    json += ",\"peak_angle\":";
+    json += String(r.peakAngle, 1);
+    json += ",\"spo2\":";
+    json += isnan(r.spo2) ? String("null") : String(r.spo2, 1);
+    json += ",\"hr\":";
+    json += isnan(r.heartRate) ? String("null") : String(r.heartRate, 1);
+    json += ",\"tidal_ml\":";
+    json += r.tidalMl < 0 ? String("null") : String(r.tidalMl);
+    json += "}";
+    count++;
+    last = seq;
+  }
+  json += "],\"next\":";
+  json += String(last);
+  json += ",\"more\":";
+  json += (seq < nextSeq ? "true" : "false");
+  json += "}";
+  g_server.send(200, "application/json", json);
+}
+
+void handleAckAlarm() {
+  // Applied by TaskControl on its next tick
+  g_alarmAckRequest = true;
+  g_server.send(200, "text/plain", "OK: Alarm Acknowledged");
+}
+
+// GET /set_time?epoch_ms=<ms>&tz_offset_min=<min>
+// Anchors the wall clock; sent by the dashboard on load. Only affects how
+// timestamps are reported, never the monotonic timebase used internally.
+void handleSetTime() {
+  if (!g_server.hasArg("epoch_ms")) {
+    g_server.send(400, "text/plain", "Bad Request: epoch_ms required");
+    return;
+  }
+  const uint64_t epochMs = strtoull(g_server.arg("epoch_ms").c_str(), nullptr, 10);
+  if (epochMs == 0) {
+    g_server.send(400, "text/plain", "Bad Request: invalid epoch_ms");
+    return;
+  }
+  const int64_t offset = static_cast<int64_t>(epochMs) - static_cast<int64_t>(timebaseUs() / 1000);
+
+  portENTER_CRITICAL(&g_sharedTimeMux);
+  const int64_t drift = offset - g_wallClockOffsetMs;
+  const bool accept = !g_wallClockSet || drift > kWallClockMaxDriftMs || drift < -kWallClockMaxDriftMs;
+  if (accept) {
+    g_wallClockOffsetMs = offset;
+    g_wallClockSet = true;
+  }
+  portEXIT_CRITICAL(&g_sharedTimeMux);
+  if (g_server.hasArg("tz_offset_min")) {
+    g_tzOffsetMin = g_server.arg("tz_offset_min").toInt();
+  }
+  g_server.send(200, "text/plain", accept ? "OK: Time Set" : "OK: Time Unchanged");
+}
+
+void rebuildStatBlock(size_t block);
+
+void logPatientData() {
+  const uint64_t nowUs = timebaseUs();
+  if (nowUs - g_lastDataLogUs < 60000000ULL) return; // Log every minute, first row 60 s after boot
+  g_lastDataLogUs = nowUs;
+  
+  PatientDataPoint point;
+  point.timestampUs = nowUs;
+  point.spo2 = g_t.spo2;
+  point.heartRate = g_t.heartRate;
+  point.tempF = isnan(g_t.tempC) ? NAN : (g_t.tempC * 9.0f / 5.0f + 32.0f);
+  point.targetBpm = g_t.targetBpm;
+  
+  const size_t slot = g_dataLogHead;
+  portENTER_CRITICAL(&g_dataLogMux);
+  g_dataLog[slot] = point;
+  g_dataLogHead = (g_dataLogHead + 1) % kMaxDataPoints;
+  if (g_dataLogCount < kMaxDataPoints) {
+    g_dataLogCount++;
+  }
+  portEXIT_CRITICAL(&g_dataLogMux);
+  rebuildStatBlock(slot / kStatBlockSize);
+}
+
+// --------------------------------------------------------------------------
+// /stats
+// --------------------------------------------------------------------------
+float statValue(const PatientDataPoint& p, size_t metric) {
+  switch (metric) {
+    case kStatSpo2:  return p.spo2;
+    case kStatHr:    return p.heartRate;
+    case kStatTempF: return p.tempF;
+    case kStatBpm:   return static_cast<float>(p.targetBpm);
+    default:         return NAN;
+  }
+}
+
+StatRow statRow(const PatientDataPoint& p) {
+  StatRow row;
+  row.timestampUs = p.timestampUs;
+  for (size_t m = 0; m < kStatMetricCount; m++) {
+    row.value[m] = statValue(p, m);
+  }
+  return row;
+}
+
+// TaskControl only (the sole writer, so it reads g_dataLog unlocked). The
+// block is built aside and swapped in under the lock: a reader never sees it
+// half rebuilt.
+void rebuildStatBlock(size_t block) {
+  const size_t first = block * kStatBlockSize;
+  size_t end = std::min(first + kStatBlockSize, kMaxDataPoints);
+  if (g_dataLogCount < kMaxDataPoints) {
+    end = std::min(end, g_dataLogHead); // Slots past the head are not written yet
+  }
+  const StatBlock b = ventilation::buildStatBlock<kStatMetricCount, kStatBins>(
+      kStatBinning, first, std::max(first, end), [](size_t slot) { return statRow(g_dataLog[slot]); });
+  portENTER_CRITICAL(&g_dataLogMux);
+  g_statBlocks[block] = b;
+  portEXIT_CRITICAL(&g_dataLogMux);
+}
+
+StatBlock readStatBlock(size_t block) {
+  portENTER_CRITICAL(&g_dataLogMux);
+  const StatBlock b = g_statBlocks[block];
+  portEXIT_CRITICAL(&g_dataLogMux);
+  return b;
+}
+
+// GET /stats?from=<ms>&to=<ms>
+// Timestamps are on the same clock as now_ms: epoch ms once /set_time has
+// anchored the wall clock, otherwise device uptime. Both bounds are optional.
+void handleStats() {
+  const uint64_t nowMs = displayMs(timebaseUs());
+  const bool hasFrom = g_server.hasArg("from");
+  const bool hasTo = g_server.hasArg("to");
+  const uint64_t fromMs = hasFrom ? strtoull(g_server.arg("from").c_str(), nullptr, 10) : 0;
+  const uint64_t toMs = hasTo ? strtoull(g_server.arg("to").c_str(), nullptr, 10) : nowMs;
+  if (hasFrom && hasTo && toMs < fromMs) {
+    g_server.send(400, "text/plain", "Bad Request: to must not be before from");
+    return;
+  }
+
+  // Logical range [first, last) of entries with from <= timestamp <= to
+  const LogView view = logView();
+  const size_t first = hasFrom ? logLowerBound(view, timebaseUsFromDisplayMs(fromMs)) : 0;
+  const size_t last = hasTo ? logLowerBound(view, timebaseUsFromDisplayMs(toMs) + 1000) : view.count;
+
+  // Blocks and rows are judged against the same view the range came from,
+  // so rows appended while this runs are not counted
+  StatResult r;
+  if (last > first) {
+    ventilation::statAccumulateRing<kStatBlockSize, kMaxDataPoints>(
+        kStatBinning, logSlot(view, first), last - first, view.oldestUs, view.newestUs,
+        [](size_t slot) { return statRow(readLogSlot(slot)); }, readStatBlock, r);
+  }
+
+  String json;
+  json.reserve(720);
+  json += "{\"from_ms\":";
+  json += u64ToString(fromMs);
+  json += ",\"to_ms\":";
+  json += u64ToString(toMs);
+  json += ",\"now_ms\":";
+  json += u64ToString(nowMs);
+  json += ",\"count\":";
+  json += String(r.rows);
+  for (size_t m = 0; m < kStatMetricCount; m++) {
+    const ventilation::StatAccum& a = r.acc[m];
+    json += ",\"";
+    json += kStatBinning[m].name;
+    json += "\":{\"count\":";
+    json += String(a.count);
+    if (a.count > 0) {
+      const double mean = a.sum / a.count;
+      const double var = a.sumSq / a.count - mean * mean;
+      json += ",\"min\":";
+      json += String(a.min, 1);
+      json += ",\"max\":";
+      json += String(a.max, 1);
+      json += ",\"mean\":";
+      json += String(mean, 2);
+      json += ",\"std\":";
+      json += String(var > 0.0 ? sqrt(var) : 0.0, 2);
+      json += ",\"p5\":";
+      json += String(ventilation::statPercentile(a, r.hist[m], kStatBinning[m], 0.05f), 1);
+      json += ",\"p50\":";
+      json += String(ventilation::statPercentile(a, r.hist[m], kStatBinning[m], 0.50f), 1);
+      json += ",\"p95\":";
+      json += String(ventilation::statPercentile(a, r.hist[m], kStatBinning[m], 0.95f), 1);
+      // Percentiles are histogram estimates: bound on their distance from
+      // the exact (nearest-rank) value, null when values fell off the bins
+      const float pErr = ventilation::statPercentileError(a, kStatBinning[m], kStatBins);
+      json += ",\"p_err\":";
+      json += isnan(pErr) ? String("null") : String(pErr, 2);
+    }
+    json += "}";
+  }
+  json += "}";
+  g_server.send(200, "application/json", json);
+}
+
+void handleRoot() {
+  const char* html = R"raw(
 <!DOCTYPE html>
 <html lang='en'>
 <head>
@@ -544,6 +2056,22 @@ void handleRoot() {
             box-shadow: 6px 6px 0px black;
         }
         
+        /* Live Sensor Data Table */
+        .live-table { width: 100%; border-collapse: collapse; font-family: monospace; font-size: 0.85rem; }
+        .live-table th, .live-table td { padding: 8px; border: 2px solid black; text-align: right; }
+        .live-table thead tr { background: #f0f0f0; }
+        .live-table .col-time { text-align: left; }
+        .live-table .col-status { text-align: center; }
+        .live-table td.col-spo2 { color: var(--blue); }
+        .live-table td.col-hr { color: var(--red); }
+        .live-table td.col-temp { color: #ff9800; }
+        .live-table td.col-vent { color: var(--green); }
+        .live-table tbody tr { background: #fff; transition: background 0.3s; }
+        .live-table tbody tr:nth-child(even) { background: #f9f9f9; }
+        .live-table tbody tr.newest { background: #e8f5e9; font-weight: 900; }
+        .live-table tbody tr.empty { display: none; }
+        .live-table .placeholder { padding: 20px; text-align: center; }
+
         /* Input Styles */
         input[type="number"], input[type="password"] {
             padding: 10px;
@@ -561,7 +2089,7 @@ void handleRoot() {
 <body>
     
     <!-- Alarm Indicator -->
-    <div id="alarm-indicator" class="alarm-indicator">🚨 CRITICAL ALERT - CHECK VITALS!</div>
+    <div id="alarm-indicator" class="alarm-indicator" onclick="fetch('/ack_alarm')" style="cursor:pointer;">🚨 CRITICAL ALERT - CHECK VITALS! <span style="font-size:0.7rem;">(tap to acknowledge)</span></div>
     
     <!-- Audio Notice Banner -->
     <div id="audio-notice" class="audio-notice" onclick="enableAudioNotice()">
@@ -592,6 +2120,7 @@ void handleRoot() {
                 <div class="label" style="border:none; margin:0; color:#00ff00;">
                     💓 Live PPG Waveform 
                     <span id="ppg-mode" style="font-size:0.7rem; opacity:0.7;">(Sensor)</span>
+                    <span style="font-size:0.6rem; opacity:0.5;">draw <span id="ecg-frame-ms">--</span> ms</span>
                 </div>
             <div class="status-badge" style="font-size:0.6rem; background:#00ff00; color:black;">Heart Rate: <span id="ecg-hr">--</span> BPM</div>
             </div>
@@ -684,20 +2213,20 @@ void handleRoot() {
         <div class="card" style="text-align: left;">
             <div class="section-head">📊 Live Sensor Data Stream</div>
             <div style="overflow-x: auto;">
-                <table style="width: 100%; border-collapse: collapse; font-family: monospace; font-size: 0.85rem;">
+                <table class="live-table">
                     <thead>
-                        <tr style="background: #f0f0f0; border: 2px solid black;">
-                            <th style="padding: 8px; border: 2px solid black; text-align: left;">Time</th>
-                            <th style="padding: 8px; border: 2px solid black; text-align: right;">SpO2 (%)</th>
-                            <th style="padding: 8px; border: 2px solid black; text-align: right;">HR (BPM)</th>
-                            <th style="padding: 8px; border: 2px solid black; text-align: right;">Temp (°F)</th>
-                            <th style="padding: 8px; border: 2px solid black; text-align: right;">Vent (BPM)</th>
-                            <th style="padding: 8px; border: 2px solid black; text-align: center;">Status</th>
+                        <tr>
+                            <th class="col-time">Time</th>
+                            <th>SpO2 (%)</th>
+                            <th>HR (BPM)</th>
+                            <th>Temp (°F)</th>
+                            <th>Vent (BPM)</th>
+                            <th class="col-status">Status</th>
                         </tr>
                     </thead>
                     <tbody id="sensor-data-table">
-                        <tr>
-                            <td colspan="6" style="padding: 20px; text-align: center; border: 2px solid black;">Loading sensor data...</td>
+                        <tr id="sensor-data-placeholder">
+                            <td colspan="6" class="placeholder">Loading sensor data...</td>
                         </tr>
                     </tbody>
                 </table>
@@ -709,914 +2238,1671 @@ void handleRoot() {
 
     </div>
 
-    <script>
-      // Redesigned ECG Wave Generator
-      const canvas = document.getElementById('ecg');
-      const ctx = canvas.getContext('2d');
-
-      function resizeCanvas() {
-        const rect = canvas.parentElement.getBoundingClientRect();
-        canvas.width = rect.width;
-        canvas.height = 200;
-      }
-      window.addEventListener('resize', resizeCanvas);
-      setTimeout(resizeCanvas, 100);
+    <!-- Report worker: streamed CSV parse + report build, off the main thread -->
+    <script type="text/js-worker" id="report-worker">
+      // Splits on the same two-character line separator handleGetData() emits
+      const LINE_SEP = '\\n';
 
-      let ecgX = 0;
-      let lastHeartBeat = 0;
-      let currentHR = 72; // Default heart rate
-      let beatDetected = false;
-      let beatStartTime = 0;
-      let lastAlarmState = false;
-      
-      // PPG waveform data
-      let ppgDataBuffer = [];
-      let ppgDisplayIndex = 0;
-      
-      // === ALARM SOUND SYSTEM ===
-      let audioContext = null;
-      let alarmOscillator = null;
-      let alarmGain = null;
-      let beepInterval = null;
-      let audioInitialized = false;
-      
-      // Initialize audio context
-      function initAudioContext() {
-        try {
-          if (!audioContext) {
-            audioContext = new (window.AudioContext || window.webkitAudioContext)();
-            console.log('✓ Audio context created');
-          }
-          if (audioContext.state === 'suspended') {
-            audioContext.resume().then(() => {
-              console.log('✓ Audio context resumed');
-              audioInitialized = true;
-            });
-          } else {
-            audioInitialized = true;
-          }
-        } catch (e) {
-          console.error('Audio initialization failed:', e);
+      function reportHead(duration, headerCells, st) {
+        const validCount = st.validCount;
+        const spo2Avg = validCount > 0 ? (st.spo2Sum / validCount).toFixed(1) : '--';
+        const hrAvg = validCount > 0 ? (st.hrSum / validCount).toFixed(0) : '--';
+        const tempAvg = validCount > 0 ? (st.tempSum / validCount).toFixed(1) : '--';
+        const bpmAvg = validCount > 0 ? (st.bpmSum / validCount).toFixed(0) : '--';
+        const spo2Min = st.spo2Min, spo2Max = st.spo2Max, hrMin = st.hrMin, hrMax = st.hrMax;
+        const tempMin = st.tempMin, tempMax = st.tempMax, bpmMin = st.bpmMin, bpmMax = st.bpmMax;
+        return `
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>Patient Ventilation Report</title>
+    <style>
+        @media print {
+            body { margin: 0; }
+            .no-print { display: none; }
         }
-      }
-      
-      // Show audio notice banner
-      setTimeout(() => {
-        const notice = document.getElementById('audio-notice');
-        if (notice) {
-          notice.style.display = 'block';
-          setTimeout(() => {
-            if (!audioInitialized) notice.style.display = 'none';
-          }, 10000);
+        body {
+            font-family: 'Courier New', monospace;
+            background: #E0E7F1;
+            margin: 0;
+            padding: 20px;
         }
-      }, 2000);
-      
-      // Enable audio from banner click
-      window.enableAudioNotice = function() {
-        initAudioContext();
-        const notice = document.getElementById('audio-notice');
-        if (notice) {
-          notice.textContent = '✅ Alert Sounds Enabled';
-          notice.style.background = '#34C759';
-          setTimeout(() => { notice.style.display = 'none'; }, 2000);
+        .report-container {
+            max-width: 1000px;
+            margin: 0 auto;
+            background: white;
+            border: 4px solid black;
+            box-shadow: 10px 10px 0 black;
         }
-        // Test the sound
-        testAlarmSound();
-      }
-      
-      // Test alarm sound
-      window.testAlarmSound = function() {
-        console.log('Testing alarm sound...');
-        initAudioContext();
-        if (!audioContext) {
-          alert('Audio not available. Click anywhere first.');
-          return;
+        .header {
+            background: #FFCC00;
+            border-bottom: 4px solid black;
+            padding: 30px;
+            text-align: center;
         }
-        
-        // Play a quick test beep
-        try {
-          const testOsc = audioContext.createOscillator();
-          const testGain = audioContext.createGain();
-          testOsc.connect(testGain);
-          testGain.connect(audioContext.destination);
-          testOsc.frequency.value = 880;
-          testGain.gain.value = 0.5;
-          testOsc.start();
-          testOsc.stop(audioContext.currentTime + 0.2);
-          console.log('✓ Test beep played');
-        } catch (e) {
-          console.error('Test sound failed:', e);
-          alert('Sound test failed: ' + e.message);
+        .header h1 {
+            margin: 0 0 10px 0;
+            font-size: 2.5rem;
+            text-transform: uppercase;
+            letter-spacing: 2px;
         }
-      }
-      
-      // Auto-enable audio on user interaction
-      document.addEventListener('click', initAudioContext);
-      document.addEventListener('touchstart', initAudioContext);
-      
-      function playAlarmSound() {
-        console.log('playAlarmSound called, audioInitialized:', audioInitialized);
-        
-        // Initialize if needed
-        initAudioContext();
-        
-        // Stop existing alarm first
-        if (alarmOscillator) {
-          console.log('Alarm already playing');
-          return;
+        .header .subtitle {
+            font-size: 1rem;
+            font-weight: bold;
         }
-        
-        if (!audioContext) {
-          console.error('No audio context available');
-          return;
+        .meta-info {
+            display: grid;
+            grid-template-columns: 1fr 1fr;
+            gap: 0;
+            border-bottom: 4px solid black;
         }
-        
-        try {
-          console.log('Starting alarm sound...');
-          
-          // Create oscillator and gain
-          alarmOscillator = audioContext.createOscillator();
-          alarmGain = audioContext.createGain();
-          
-          alarmOscillator.connect(alarmGain);
-          alarmGain.connect(audioContext.destination);
-          
-          alarmOscillator.type = 'square';
-          alarmOscillator.frequency.value = 880; // 880 Hz
-          alarmGain.gain.value = 0;
-          
-          alarmOscillator.start();
-          
-          // Beeping pattern
-          let isBeeping = false;
-          beepInterval = setInterval(() => {
-            if (alarmGain) {
-              isBeeping = !isBeeping;
-              alarmGain.gain.value = isBeeping ? 0.5 : 0;
-            }
-          }, 300);
-          
-          console.log('✓ Alarm sound started');
-        } catch (e) {
-          console.error('Failed to play alarm:', e);
-          alarmOscillator = null;
-          alarmGain = null;
+        .meta-item {
+            padding: 15px 20px;
+            border: 2px solid black;
+            background: #f9f9f9;
         }
-      }
-      
-      function stopAlarmSound() {
-        console.log('stopAlarmSound called');
-        
-        try {
-          if (beepInterval) {
-            clearInterval(beepInterval);
-            beepInterval = null;
-          }
-          
-          if (alarmGain) {
-            alarmGain.gain.value = 0;
-          }
-          
-          if (alarmOscillator) {
-            alarmOscillator.stop();
-            alarmOscillator.disconnect();
-            alarmOscillator = null;
-          }
-          
-          if (alarmGain) {
-            alarmGain.disconnect();
-            alarmGain = null;
-          }
-          
-          console.log('✓ Alarm sound stopped');
-        } catch (e) {
-          console.error('Error stopping alarm:', e);
-          alarmOscillator = null;
-          alarmGain = null;
-          beepInterval = null;
+        .meta-label {
+            font-weight: 900;
+            font-size: 0.85rem;
+            text-transform: uppercase;
+            color: #555;
         }
-      }
-      
-      // ECG waveform parameters
-      function generateECGPoint(phase) {
-        // Only show wave during beat, otherwise flat line with slight drift
-        if (!beatDetected) {
-          // Slow baseline drift when no beat
-          return Math.sin(Date.now() / 2000) * 0.02;
+        .meta-value {
+            font-size: 1.1rem;
+            font-weight: bold;
+            margin-top: 5px;
+        }
+        .section {
+            padding: 30px;
+            border-bottom: 4px solid black;
+        }
+        .section:last-child { border-bottom: none; }
+        .section-title {
+            font-size: 1.5rem;
+            font-weight: 900;
+            text-transform: uppercase;
+            margin: 0 0 20px 0;
+            padding-bottom: 10px;
+            border-bottom: 3px solid black;
+        }
+        .stats-grid {
+            display: grid;
+            grid-template-columns: repeat(auto-fit, minmax(200px, 1fr));
+            gap: 15px;
+            margin-bottom: 20px;
+        }
+        .stat-card {
+            border: 3px solid black;
+            padding: 15px;
+            background: #fff;
+            box-shadow: 4px 4px 0 black;
+        }
+        .stat-card .label {
+            font-size: 0.75rem;
+            font-weight: 900;
+            text-transform: uppercase;
+            color: #666;
+            margin-bottom: 8px;
+        }
+        .stat-card .value {
+            font-size: 2rem;
+            font-weight: 900;
+            line-height: 1;
+        }
+        .stat-card .range {
+            font-size: 0.85rem;
+            margin-top: 8px;
+            color: #666;
         }
+        .c-spo2 { color: #007AFF; }
+        .c-hr { color: #FF3B30; }
+        .c-temp { color: #FFCC00; text-shadow: 1px 1px 0 black; }
+        .c-vent { color: #34C759; }
         
-        // Realistic ECG waveform generation during beat
-        // P wave (0.0 - 0.15)
-        if (phase < 0.15) {
-          const t = phase / 0.15;
-          return 0.15 * Math.sin(Math.PI * t);
+        table {
+            width: 100%;
+            border-collapse: collapse;
+            margin-top: 20px;
         }
-        // PR segment (0.15 - 0.20)
-        else if (phase < 0.20) {
-          return 0;
+        th {
+            background: #000;
+            color: white;
+            padding: 12px;
+            text-align: left;
+            font-weight: 900;
+            text-transform: uppercase;
+            font-size: 0.85rem;
+            border: 2px solid black;
         }
-        // Q wave (0.20 - 0.23)
-        else if (phase < 0.23) {
-          const t = (phase - 0.20) / 0.03;
-          return -0.15 * Math.sin(Math.PI * t);
+        td {
+            padding: 10px 12px;
+            border: 2px solid black;
+            background: white;
         }
-        // R wave (0.23 - 0.28)
-        else if (phase < 0.28) {
-          const t = (phase - 0.23) / 0.05;
-          return 1.0 * Math.sin(Math.PI * t);
+        tr:nth-child(even) td {
+            background: #f9f9f9;
         }
-        // S wave (0.28 - 0.31)
-        else if (phase < 0.31) {
-          const t = (phase - 0.28) / 0.03;
-          return -0.25 * Math.sin(Math.PI * t);
+        .footer {
+            padding: 20px 30px;
+            background: #f0f0f0;
+            border-top: 4px solid black;
+            text-align: center;
+            font-size: 0.85rem;
         }
-        // ST segment (0.31 - 0.45)
-        else if (phase < 0.45) {
-          return 0;
+        .print-btn {
+            padding: 15px 30px;
+            background: #8C52FF;
+            color: white;
+            border: 3px solid black;
+            font-weight: 900;
+            font-size: 1rem;
+            cursor: pointer;
+            text-transform: uppercase;
+            box-shadow: 4px 4px 0 black;
+            margin: 20px auto;
+            display: block;
         }
-        // T wave (0.45 - 0.65)
-        else if (phase < 0.65) {
-          const t = (phase - 0.45) / 0.20;
-          return 0.25 * Math.sin(Math.PI * t);
+        .print-btn:hover {
+            transform: translate(-2px, -2px);
+            box-shadow: 6px 6px 0 black;
         }
-        // End of beat - return to baseline
-        else {
-          beatDetected = false;
-          return Math.sin(Date.now() / 2000) * 0.02;
+        .print-btn:active {
+            transform: translate(2px, 2px);
+            box-shadow: 2px 2px 0 black;
         }
-      }
-
-      function drawECG() {
-        const w = canvas.width;
-        const h = canvas.height;
-        const centerY = h / 2;
-        const now = Date.now();
-        
-        // Shift canvas left (scrolling effect)
-        const imageData = ctx.getImageData(3, 0, w - 3, h);
-        ctx.putImageData(imageData, 0, 0);
-        
-        // Clear the rightmost strip
-        ctx.fillStyle = '#0a0a0a';
-        ctx.fillRect(w - 3, 0, 3, h);
+    </style>
+</head>
+<body>
+    <div class="report-container">
+        <div class="header">
+            <h1>❤️ Patient Ventilation Report</h1>
+            <div class="subtitle">AutoVent AI System - Medical Data Summary</div>
+        </div>
         
-        let y = centerY;
+        <div class="meta-info">
+            <div class="meta-item">
+                <div class="meta-label">Report Generated</div>
+                <div class="meta-value">${new Date().toLocaleString()}</div>
+            </div>
+            <div class="meta-item">
+                <div class="meta-label">Data Duration</div>
+                <div class="meta-value">${duration.toUpperCase()} • ${validCount} Readings</div>
+            </div>
+        </div>
         
-        // Use real PPG data if available
-        if (ppgDataBuffer.length > 0) {
-          // Get next PPG value from sensor
-          if (ppgDisplayIndex >= ppgDataBuffer.length) {
-            ppgDisplayIndex = 0;
-          }
-          
-          const rawValue = ppgDataBuffer[ppgDisplayIndex];
-          ppgDisplayIndex++;
-          
-          // Normalize PPG value (typical MAX30100 IR range: 30000-100000)
-          // Adjust these values based on your sensor's actual readings
-          const minPpg = 30000;
-          const maxPpg = 100000;
-          const normalized = ((rawValue - minPpg) / (maxPpg - minPpg)) * 2 - 1; // -1 to +1
-          const clipped = Math.max(-1, Math.min(1, normalized));
-          
-          // Scale to canvas
-          const amplitude = h * 0.4;
-          y = centerY - (clipped * amplitude);
-        } else {
-          // Fall back to simulated ECG if no sensor data
-          let phase = 0;
-          if (beatDetected) {
-            const beatDuration = 600;
-            const timeSinceBeat = now - beatStartTime;
-            phase = timeSinceBeat / beatDuration;
-            
-            if (phase >= 1.0) {
-              beatDetected = false;
-            }
-          }
-          
-          const ecgValue = generateECGPoint(phase);
-          const noise = (Math.random() - 0.5) * 0.015;
-          const finalValue = ecgValue + noise;
-          const amplitude = h * 0.35;
-          y = centerY - (finalValue * amplitude);
-        }
-        
-        // Draw the waveform
-        ctx.strokeStyle = '#00ff00';
-        ctx.lineWidth = 2;
-        ctx.shadowBlur = 8;
-        ctx.shadowColor = '#00ff00';
-        
-        ctx.beginPath();
-        ctx.moveTo(w - 6, canvas.lastY || centerY);
-        ctx.lineTo(w - 3, y);
-        ctx.stroke();
-        
-        canvas.lastY = y;
+        <div class="section">
+            <h2 class="section-title">📊 Statistical Summary</h2>
+            <div class="stats-grid">
+                <div class="stat-card">
+                    <div class="label">Oxygen Saturation (SpO2)</div>
+                    <div class="value c-spo2">${spo2Avg}<span style="font-size:1rem">%</span></div>
+                    <div class="range">Range: ${spo2Min.toFixed(1)}% - ${spo2Max.toFixed(1)}%</div>
+                </div>
+                <div class="stat-card">
+                    <div class="label">Heart Rate</div>
+                    <div class="value c-hr">${hrAvg}<span style="font-size:1rem">BPM</span></div>
+                    <div class="range">Range: ${hrMin.toFixed(0)} - ${hrMax.toFixed(0)} BPM</div>
+                </div>
+                <div class="stat-card">
+                    <div class="label">Body Temperature</div>
+                    <div class="value c-temp">${tempAvg}<span style="font-size:1rem">°F</span></div>
+                    <div class="range">Range: ${tempMin.toFixed(1)}°F - ${tempMax.toFixed(1)}°F</div>
+                </div>
+                <div class="stat-card">
+                    <div class="label">Ventilation Rate</div>
+                    <div class="value c-vent">${bpmAvg}<span style="font-size:1rem">BPM</span></div>
+                    <div class="range">Range: ${bpmMin} - ${bpmMax} BPM</div>
+                </div>
+            </div>
+        </div>
         
-        requestAnimationFrame(drawECG);
+        <div class="section">
+            <h2 class="section-title">📋 Detailed Data Log</h2>
+            <table>
+                <thead>
+                    <tr>
+                        ${headerCells}
+                    </tr>
+                </thead>
+                <tbody>
+`;
       }
 
-      // Start ECG animation
-      lastHeartBeat = Date.now();
-      drawECG();
-
-        // Sensor data collection array
-        const sensorDataHistory = [];
-        const maxHistoryItems = 10;
-
-        function updateSensorDataTable(data) {
-            const now = new Date();
-            const timeStr = now.toLocaleTimeString();
-            
-            // Add new reading to history
-            sensorDataHistory.unshift({
-                time: timeStr,
-                spo2: data.spo2 ? data.spo2.toFixed(1) : '--',
-                hr: data.hr ? data.hr.toFixed(0) : '--',
-                temp: data.temp_f ? data.temp_f.toFixed(1) : '--',
-                bpm: data.target_bpm || '--',
-                status: data.sensor_ok ? '✓ Online' : '✗ Offline'
-            });
-            
-            // Keep only last 10 items
-            if (sensorDataHistory.length > maxHistoryItems) {
-                sensorDataHistory.pop();
-            }
-            
-            // Update table
-            const tbody = document.getElementById('sensor-data-table');
-            tbody.innerHTML = '';
-            
-            sensorDataHistory.forEach((reading, index) => {
-                const row = document.createElement('tr');
-                row.style.background = index % 2 === 0 ? '#fff' : '#f9f9f9';
-                row.style.transition = 'all 0.3s';
-                
-                if (index === 0) {
-                    row.style.background = '#e8f5e9';
-                    row.style.fontWeight = '900';
-                }
-                
-                row.innerHTML = `
-                    <td style="padding: 8px; border: 2px solid black;">${reading.time}</td>
-                    <td style="padding: 8px; border: 2px solid black; text-align: right; color: var(--blue);">${reading.spo2}</td>
-                    <td style="padding: 8px; border: 2px solid black; text-align: right; color: var(--red);">${reading.hr}</td>
-                    <td style="padding: 8px; border: 2px solid black; text-align: right; color: #ff9800;">${reading.temp}</td>
-                    <td style="padding: 8px; border: 2px solid black; text-align: right; color: var(--green);">${reading.bpm}</td>
-                    <td style="padding: 8px; border: 2px solid black; text-align: center;">${reading.status}</td>
-                `;
-                tbody.appendChild(row);
-            });
-        }
-
-        function setSim(v) { fetch('/set_spo2?val='+v); }
+      const REPORT_TAIL = `                </tbody>
+            </table>
+        </div>
         
-        async function loop() {
-            try {
-                const r = await fetch('/status');
-                const d = await r.json();
-                
-                // Update PPG data buffer for real waveform display
-                if (d.ppg && Array.isArray(d.ppg) && d.ppg.length > 0) {
-                    ppgDataBuffer = d.ppg;
-                    ppgDisplayIndex = 0;
-                    // Update mode indicator
-                    const modeEl = document.getElementById('ppg-mode');
-                    if (modeEl) modeEl.textContent = '(Real Sensor Data)';
-                    console.log('PPG data received:', d.ppg.length, 'samples, range:', Math.min(...d.ppg), '-', Math.max(...d.ppg));
-                } else {
-                    // Fallback to simulated
-                    const modeEl = document.getElementById('ppg-mode');
-                    if (modeEl) modeEl.textContent = '(Simulated)';
-                }
-                
-                document.getElementById('spo2').textContent = d.spo2 ? d.spo2.toFixed(1) : '--';
-                
-                const hr = d.hr ? d.hr.toFixed(0) : '--';
-                document.getElementById('hr').textContent = hr;
-                
-                // Update ECG heart rate display
-                if (d.hr && d.hr > 0) {
-                    currentHR = d.hr;
-                    document.getElementById('ecg-hr').textContent = d.hr.toFixed(0);
-                } else {
-                    document.getElementById('ecg-hr').textContent = '--';
-                }
-                
-                // Trigger ECG wave when beat is detected (fallback for simulated mode)
-                if (d.beat_detected && !beatDetected) {
-                    beatDetected = true;
-                    beatStartTime = Date.now();
-                }
-                
-                if(d.temp_f === null || d.temp_f === undefined) {
-                  document.getElementById('temp').textContent = '--';
-                } else {
-                  document.getElementById('temp').textContent = d.temp_f.toFixed(1);
-                }
+        <div class="footer">
+            <strong>⚠️ DISCLAIMER:</strong> This is a demonstration/hobby device. 
+            Not for clinical or medical use. Data provided for educational purposes only.
+            <br><br>
+            Generated by AutoVent AI System • DIY Ventilator Project
+        </div>
+    </div>
+    
+    <button class="print-btn no-print" onclick="window.print()">🖨️ Print Report</button>
+</body>
+</html>`;
 
-                const bpm = d.target_bpm || 0;
-                document.getElementById('bpm').textContent = bpm;
-                
-                // Animate Breath
-                if(bpm > 0) {
-                    const sec = 60 / bpm;
-                    document.getElementById('breath-anim').style.animationDuration = sec + 's';
-                }
+      // Each request carries an id that is echoed back, since several
+      // downloads can be in flight at once
+      self.onmessage = async (ev) => {
+        const { id, url, duration } = ev.data;
+        try {
+          const r = await fetch(url);
+          if (!r.ok) {
+            self.postMessage({ id, error: 'Error downloading data: ' + await r.text() });
+            return;
+          }
 
-                // Status
-                const s = document.getElementById('status');
-                if(d.sensor_ok) { s.textContent = "System Online"; s.style.background = "var(--green)"; }
-                else { s.textContent = "Connecting Sensor..."; s.style.background = "var(--red)"; }
-
-                // Mode
-                const m = document.getElementById('mode-badge');
-                if(d.manual_mode) { 
-                    m.textContent = "Manual Override"; 
-                    m.style.background = "var(--red)";
-                    m.style.color = "white";
-                }
-                else { 
-                    m.textContent = "Auto"; 
-                    m.style.background = "var(--yellow)";
-                    m.style.color = "black";
-                }
+          const st = {
+            spo2Sum: 0, hrSum: 0, tempSum: 0, bpmSum: 0,
+            spo2Min: 100, hrMin: 200, tempMin: 120, bpmMin: 100,
+            spo2Max: 0, hrMax: 0, tempMax: 0, bpmMax: 0,
+            validCount: 0
+          };
+          let headerCells = '';
+          let sawHeader = false;
+          const rowParts = [];
 
-                // Alarm
-                const alarm = document.getElementById('alarm-indicator');
-                if(d.alarm_active) {
-                    console.log('🚨 ALARM ACTIVE - alarm_active:', d.alarm_active, 'lastAlarmState:', lastAlarmState);
-                    alarm.style.display = 'block';
-                    // Play sound when alarm becomes active
-                    if (!lastAlarmState) {
-                        console.log('🔊 Triggering alarm sound...');
-                        playAlarmSound();
-                        // Also show browser notification if supported
-                        if ('Notification' in window && Notification.permission === 'granted') {
-                            new Notification('⚠️ CRITICAL ALERT', {
-                                body: 'Patient vitals require immediate attention!',
-                                icon: 'data:image/svg+xml,<svg xmlns="http://www.w3.org/2000/svg" viewBox="0 0 100 100"><text y="70" font-size="70">⚠️</text></svg>',
-                                requireInteraction: true
-                            });
-                        }
-                    }
-                } else {
-                    alarm.style.display = 'none';
-                    // Stop sound when alarm becomes inactive
-                    if (lastAlarmState) {
-                        console.log('✓ Alarm cleared - stopping sound');
-                        stopAlarmSound();
-                    }
-                }
-                lastAlarmState = d.alarm_active;
-                
-                // Update sensor data table
-                updateSensorDataTable(d);
-              } catch (e) {
+          const handleLine = (line) => {
+            if (!line.trim()) return;
+            const row = line.split(',');
+            if (!sawHeader) {
+              sawHeader = true;
+              headerCells = row.map(header => '<th>' + header + '</th>').join('');
+              return;
+            }
+            rowParts.push('<tr>' + row.map(cell => '<td>' + cell + '</td>').join('') + '</tr>');
+            if (row.length >= 5) {
+              const spo2 = parseFloat(row[1]);
+              const hr = parseFloat(row[2]);
+              const temp = parseFloat(row[3]);
+              const bpm = parseFloat(row[4]);
+              if (!isNaN(spo2) && !isNaN(hr) && !isNaN(temp) && !isNaN(bpm)) {
+                st.spo2Sum += spo2; st.hrSum += hr; st.tempSum += temp; st.bpmSum += bpm;
+                st.spo2Min = Math.min(st.spo2Min, spo2); st.hrMin = Math.min(st.hrMin, hr);
+                st.tempMin = Math.min(st.tempMin, temp); st.bpmMin = Math.min(st.bpmMin, bpm);
+                st.spo2Max = Math.max(st.spo2Max, spo2); st.hrMax = Math.max(st.hrMax, hr);
+                st.tempMax = Math.max(st.tempMax, temp); st.bpmMax = Math.max(st.bpmMax, bpm);
+                st.validCount++;
               }
             }
+          };
 
-            async function setBpm() {
-                const password = document.getElementById('bpm-password').value;
-                const bpm = document.getElementById('bpm-value').value;
-                const resultDiv = document.getElementById('bpm-result');
-                
-                if (!password || !bpm) {
-                    resultDiv.textContent = '❌ Please enter both password and BPM value';
-                    resultDiv.style.color = 'red';
-                    return;
-                }
-                
-                try {
-                    const r = await fetch('/set_bpm?password=' + encodeURIComponent(password) + '&bpm=' + encodeURIComponent(bpm));
-                    const text = await r.text();
-                    
-                    if (r.ok) {
-                        resultDiv.textContent = '✅ ' + text;
-                        resultDiv.style.color = 'green';
-                        document.getElementById('bpm-password').value = '';
-                        document.getElementById('bpm-value').value = '';
-                    } else {
-                        resultDiv.textContent = '❌ ' + text;
-                        resultDiv.style.color = 'red';
-                    }
-                } catch (e) {
-                    resultDiv.textContent = '❌ Error: ' + e.message;
-                    resultDiv.style.color = 'red';
-                }
+          // Parse as chunks arrive; only the unfinished last line is buffered
+          const reader = r.body.getReader();
+          const decoder = new TextDecoder();
+          let pending = '';
+          for (;;) {
+            const { done, value } = await reader.read();
+            if (done) break;
+            pending += decoder.decode(value, { stream: true });
+            let sep;
+            while ((sep = pending.indexOf(LINE_SEP)) >= 0) {
+              handleLine(pending.slice(0, sep));
+              pending = pending.slice(sep + LINE_SEP.length);
             }
+          }
+          pending += decoder.decode();
+          handleLine(pending);
 
-            async function downloadData(duration) {
-                try {
-                    const r = await fetch('/get_data?duration=' + duration);
-                    const csv = await r.text();
-                    
-                    if (!r.ok) {
-                        alert('Error downloading data: ' + csv);
-                        return;
-                    }
-                    
-                    // Parse CSV data
-                    const lines = csv.split('\\n');
-                    const pdfData = [];
-                    
-                    for (let i = 0; i < lines.length; i++) {
-                        if (lines[i].trim()) {
-                            pdfData.push(lines[i].split(','));
-                        }
-                    }
-                    
-                    // Calculate statistics
-                    let spo2Sum = 0, hrSum = 0, tempSum = 0, bpmSum = 0;
-                    let spo2Min = 100, hrMin = 200, tempMin = 120, bpmMin = 100;
-                    let spo2Max = 0, hrMax = 0, tempMax = 0, bpmMax = 0;
-                    let validCount = 0;
-                    
-                    for (let i = 1; i < pdfData.length; i++) { // Skip header
-                        const row = pdfData[i];
-                        if (row.length >= 5) {
-                            const spo2 = parseFloat(row[1]);
-                            const hr = parseFloat(row[2]);
-                            const temp = parseFloat(row[3]);
-                            const bpm = parseFloat(row[4]);
-                            
-                            if (!isNaN(spo2) && !isNaN(hr) && !isNaN(temp) && !isNaN(bpm)) {
-                                spo2Sum += spo2; hrSum += hr; tempSum += temp; bpmSum += bpm;
-                                spo2Min = Math.min(spo2Min, spo2); hrMin = Math.min(hrMin, hr);
-                                tempMin = Math.min(tempMin, temp); bpmMin = Math.min(bpmMin, bpm);
-                                spo2Max = Math.max(spo2Max, spo2); hrMax = Math.max(hrMax, hr);
-                                tempMax = Math.max(tempMax, temp); bpmMax = Math.max(bpmMax, bpm);
-                                validCount++;
-                            }
-                        }
-                    }
-                    
-                    const spo2Avg = validCount > 0 ? (spo2Sum / validCount).toFixed(1) : '--';
-                    const hrAvg = validCount > 0 ? (hrSum / validCount).toFixed(0) : '--';
-                    const tempAvg = validCount > 0 ? (tempSum / validCount).toFixed(1) : '--';
-                    const bpmAvg = validCount > 0 ? (bpmSum / validCount).toFixed(0) : '--';
-                    
-                    // Create professional HTML report
-                    const reportHtml = `
-<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Patient Ventilation Report</title>
-    <style>
-        @media print {
-            body { margin: 0; }
-            .no-print { display: none; }
+          const blob = new Blob([reportHead(duration, headerCells, st)].concat(rowParts, [REPORT_TAIL]),
+                                { type: 'text/html' });
+          self.postMessage({ id, blob });
+        } catch (e) {
+          self.postMessage({ id, error: 'Error: ' + e.message });
         }
-        body {
-            font-family: 'Courier New', monospace;
-            background: #E0E7F1;
-            margin: 0;
-            padding: 20px;
+      };
+    </script>
+
+    <script>
+      // Redesigned ECG Wave Generator
+      const canvas = document.getElementById('ecg');
+      const ctx = canvas.getContext('2d');
+
+      function resizeCanvas() {
+        const rect = canvas.parentElement.getBoundingClientRect();
+        canvas.width = rect.width;
+        canvas.height = 200;
+        // Resizing wipes the bitmap; restart the sweep from the left
+        sweepX = 0;
+        sweepLastY = null;
+      }
+      window.addEventListener('resize', resizeCanvas);
+      setTimeout(resizeCanvas, 100);
+
+      let ecgX = 0;
+      let lastHeartBeat = 0;
+      let currentHR = 72; // Default heart rate
+      let beatDetected = false;
+      let beatStartTime = 0;
+      let lastAlarmState = false;
+      
+      // PPG waveform data
+      let ppgDataBuffer = [];
+      let ppgDisplayIndex = 0;
+      
+      // === ALARM SOUND SYSTEM ===
+      let audioContext = null;
+      let alarmOscillator = null;
+      let alarmGain = null;
+      let beepInterval = null;
+      let audioInitialized = false;
+      
+      // Initialize audio context
+      function initAudioContext() {
+        try {
+          if (!audioContext) {
+            audioContext = new (window.AudioContext || window.webkitAudioContext)();
+            console.log('✓ Audio context created');
+          }
+          if (audioContext.state === 'suspended') {
+            audioContext.resume().then(() => {
+              console.log('✓ Audio context resumed');
+              audioInitialized = true;
+            });
+          } else {
+            audioInitialized = true;
+          }
+        } catch (e) {
+          console.error('Audio initialization failed:', e);
         }
-        .report-container {
-            max-width: 1000px;
-            margin: 0 auto;
-            background: white;
-            border: 4px solid black;
-            box-shadow: 10px 10px 0 black;
-        }
-        .header {
-            background: #FFCC00;
-            border-bottom: 4px solid black;
-            padding: 30px;
-            text-align: center;
+      }
+      
+      // Show audio notice banner
+      setTimeout(() => {
+        const notice = document.getElementById('audio-notice');
+        if (notice) {
+          notice.style.display = 'block';
+          setTimeout(() => {
+            if (!audioInitialized) notice.style.display = 'none';
+          }, 10000);
         }
-        .header h1 {
-            margin: 0 0 10px 0;
-            font-size: 2.5rem;
-            text-transform: uppercase;
-            letter-spacing: 2px;
+      }, 2000);
+      
+      // Enable audio from banner click
+      window.enableAudioNotice = function() {
+        initAudioContext();
+        const notice = document.getElementById('audio-notice');
+        if (notice) {
+          notice.textContent = '✅ Alert Sounds Enabled';
+          notice.style.background = '#34C759';
+          setTimeout(() => { notice.style.display = 'none'; }, 2000);
         }
-        .header .subtitle {
-            font-size: 1rem;
-            font-weight: bold;
+        // Test the sound
+        testAlarmSound();
+      }
+      
+      // Test alarm sound
+      window.testAlarmSound = function() {
+        console.log('Testing alarm sound...');
+        initAudioContext();
+        if (!audioContext) {
+          alert('Audio not available. Click anywhere first.');
+          return;
         }
-        .meta-info {
-            display: grid;
-            grid-template-columns: 1fr 1fr;
-            gap: 0;
-            border-bottom: 4px solid black;
+        
+        // Play a quick test beep
+        try {
+          const testOsc = audioContext.createOscillator();
+          const testGain = audioContext.createGain();
+          testOsc.connect(testGain);
+          testGain.connect(audioContext.destination);
+          testOsc.frequency.value = 880;
+          testGain.gain.value = 0.5;
+          testOsc.start();
+          testOsc.stop(audioContext.currentTime + 0.2);
+          console.log('✓ Test beep played');
+        } catch (e) {
+          console.error('Test sound failed:', e);
+          alert('Sound test failed: ' + e.message);
         }
-        .meta-item {
-            padding: 15px 20px;
-            border: 2px solid black;
-            background: #f9f9f9;
+      }
+      
+      // Auto-enable audio on user interaction
+      document.addEventListener('click', initAudioContext);
+      document.addEventListener('touchstart', initAudioContext);
+      
+      function playAlarmSound() {
+        console.log('playAlarmSound called, audioInitialized:', audioInitialized);
+        
+        // Initialize if needed
+        initAudioContext();
+        
+        // Stop existing alarm first
+        if (alarmOscillator) {
+          console.log('Alarm already playing');
+          return;
         }
-        .meta-label {
-            font-weight: 900;
-            font-size: 0.85rem;
-            text-transform: uppercase;
-            color: #555;
+        
+        if (!audioContext) {
+          console.error('No audio context available');
+          return;
         }
-        .meta-value {
-            font-size: 1.1rem;
-            font-weight: bold;
-            margin-top: 5px;
+        
+        try {
+          console.log('Starting alarm sound...');
+          
+          // Create oscillator and gain
+          alarmOscillator = audioContext.createOscillator();
+          alarmGain = audioContext.createGain();
+          
+          alarmOscillator.connect(alarmGain);
+          alarmGain.connect(audioContext.destination);
+          
+          alarmOscillator.type = 'square';
+          alarmOscillator.frequency.value = 880; // 880 Hz
+          alarmGain.gain.value = 0;
+          
+          alarmOscillator.start();
+          
+          // Beeping pattern
+          let isBeeping = false;
+          beepInterval = setInterval(() => {
+            if (alarmGain) {
+              isBeeping = !isBeeping;
+              alarmGain.gain.value = isBeeping ? 0.5 : 0;
+            }
+          }, 300);
+          
+          console.log('✓ Alarm sound started');
+        } catch (e) {
+          console.error('Failed to play alarm:', e);
+          alarmOscillator = null;
+          alarmGain = null;
         }
-        .section {
-            padding: 30px;
-            border-bottom: 4px solid black;
+      }
+      
+      function stopAlarmSound() {
+        console.log('stopAlarmSound called');
+        
+        try {
+          if (beepInterval) {
+            clearInterval(beepInterval);
+            beepInterval = null;
+          }
+          
+          if (alarmGain) {
+            alarmGain.gain.value = 0;
+          }
+          
+          if (alarmOscillator) {
+            alarmOscillator.stop();
+            alarmOscillator.disconnect();
+            alarmOscillator = null;
+          }
+          
+          if (alarmGain) {
+            alarmGain.disconnect();
+            alarmGain = null;
+          }
+          
+          console.log('✓ Alarm sound stopped');
+        } catch (e) {
+          console.error('Error stopping alarm:', e);
+          alarmOscillator = null;
+          alarmGain = null;
+          beepInterval = null;
         }
-        .section:last-child { border-bottom: none; }
-        .section-title {
-            font-size: 1.5rem;
-            font-weight: 900;
-            text-transform: uppercase;
-            margin: 0 0 20px 0;
-            padding-bottom: 10px;
-            border-bottom: 3px solid black;
+      }
+      
+      // ECG waveform parameters
+      function generateECGPoint(phase) {
+        // Only show wave during beat, otherwise flat line with slight drift
+        if (!beatDetected) {
+          // Slow baseline drift when no beat
+          return Math.sin(Date.now() / 2000) * 0.02;
         }
-        .stats-grid {
-            display: grid;
-            grid-template-columns: repeat(auto-fit, minmax(200px, 1fr));
-            gap: 15px;
-            margin-bottom: 20px;
+        
+        // Realistic ECG waveform generation during beat
+        // P wave (0.0 - 0.15)
+        if (phase < 0.15) {
+          const t = phase / 0.15;
+          return 0.15 * Math.sin(Math.PI * t);
         }
-        .stat-card {
-            border: 3px solid black;
-            padding: 15px;
-            background: #fff;
-            box-shadow: 4px 4px 0 black;
+        // PR segment (0.15 - 0.20)
+        else if (phase < 0.20) {
+          return 0;
         }
-        .stat-card .label {
-            font-size: 0.75rem;
-            font-weight: 900;
-            text-transform: uppercase;
-            color: #666;
-            margin-bottom: 8px;
+        // Q wave (0.20 - 0.23)
+        else if (phase < 0.23) {
+          const t = (phase - 0.20) / 0.03;
+          return -0.15 * Math.sin(Math.PI * t);
         }
-        .stat-card .value {
-            font-size: 2rem;
-            font-weight: 900;
-            line-height: 1;
+        // R wave (0.23 - 0.28)
+        else if (phase < 0.28) {
+          const t = (phase - 0.23) / 0.05;
+          return 1.0 * Math.sin(Math.PI * t);
         }
-        .stat-card .range {
-            font-size: 0.85rem;
-            margin-top: 8px;
-            color: #666;
+        // S wave (0.28 - 0.31)
+        else if (phase < 0.31) {
+          const t = (phase - 0.28) / 0.03;
+          return -0.25 * Math.sin(Math.PI * t);
         }
-        .c-spo2 { color: #007AFF; }
-        .c-hr { color: #FF3B30; }
-        .c-temp { color: #FFCC00; text-shadow: 1px 1px 0 black; }
-        .c-vent { color: #34C759; }
-        
-        table {
-            width: 100%;
-            border-collapse: collapse;
-            margin-top: 20px;
+        // ST segment (0.31 - 0.45)
+        else if (phase < 0.45) {
+          return 0;
         }
-        th {
-            background: #000;
-            color: white;
-            padding: 12px;
-            text-align: left;
-            font-weight: 900;
-            text-transform: uppercase;
-            font-size: 0.85rem;
-            border: 2px solid black;
+        // T wave (0.45 - 0.65)
+        else if (phase < 0.65) {
+          const t = (phase - 0.45) / 0.20;
+          return 0.25 * Math.sin(Math.PI * t);
         }
-        td {
-            padding: 10px 12px;
-            border: 2px solid black;
-            background: white;
-        }
-        tr:nth-child(even) td {
-            background: #f9f9f9;
+        // End of beat - return to baseline
+        else {
+          beatDetected = false;
+          return Math.sin(Date.now() / 2000) * 0.02;
         }
-        .footer {
-            padding: 20px 30px;
-            background: #f0f0f0;
-            border-top: 4px solid black;
-            text-align: center;
-            font-size: 0.85rem;
+      }
+
+      // Monitor-style sweep: the pen moves left to right and only the newest
+      // segment is drawn each frame, with an erase bar just ahead of it.
+      // Nothing is copied or scrolled, so per-frame cost is a few pixels wide.
+      const SWEEP_PX_PER_SEC = 180;
+      const SWEEP_STEP_PX = 3;
+      const SWEEP_ERASE_PX = 16;
+      let sweepX = 0;
+      let sweepLastY = null;
+      let sweepLastTs = null;
+      let sweepCarry = 0;
+      let frameMsAvg = 0;
+      let frameMsLastShown = 0;
+
+      function nextWaveY(h, now) {
+        const centerY = h / 2;
+
+        // Use real PPG data if available
+        if (ppgDataBuffer.length > 0) {
+          // Get next PPG value from sensor
+          if (ppgDisplayIndex >= ppgDataBuffer.length) {
+            ppgDisplayIndex = 0;
+          }
+          
+          const rawValue = ppgDataBuffer[ppgDisplayIndex];
+          ppgDisplayIndex++;
+          
+          // Normalize PPG value (typical MAX30100 IR range: 30000-100000)
+          // Adjust these values based on your sensor's actual readings
+          const minPpg = 30000;
+          const maxPpg = 100000;
+          const normalized = ((rawValue - minPpg) / (maxPpg - minPpg)) * 2 - 1; // -1 to +1
+          const clipped = Math.max(-1, Math.min(1, normalized));
+          
+          // Scale to canvas
+          const amplitude = h * 0.4;
+          return centerY - (clipped * amplitude);
         }
-        .print-btn {
-            padding: 15px 30px;
-            background: #8C52FF;
-            color: white;
-            border: 3px solid black;
-            font-weight: 900;
-            font-size: 1rem;
-            cursor: pointer;
-            text-transform: uppercase;
-            box-shadow: 4px 4px 0 black;
-            margin: 20px auto;
-            display: block;
+
+        // Fall back to simulated ECG if no sensor data
+        let phase = 0;
+        if (beatDetected) {
+          const beatDuration = 600;
+          const timeSinceBeat = now - beatStartTime;
+          phase = timeSinceBeat / beatDuration;
+          
+          if (phase >= 1.0) {
+            beatDetected = false;
+          }
         }
-        .print-btn:hover {
-            transform: translate(-2px, -2px);
-            box-shadow: 6px 6px 0 black;
+        
+        const ecgValue = generateECGPoint(phase);
+        const noise = (Math.random() - 0.5) * 0.015;
+        const finalValue = ecgValue + noise;
+        const amplitude = h * 0.35;
+        return centerY - (finalValue * amplitude);
+      }
+
+      function drawECG(ts) {
+        const t0 = performance.now();
+        const w = canvas.width;
+        const h = canvas.height;
+        const now = Date.now();
+
+        if (sweepLastTs !== null && w > 0) {
+          // Advance by wall time, not frame count; never more than one screen
+          sweepCarry = Math.min(sweepCarry + (ts - sweepLastTs) * SWEEP_PX_PER_SEC / 1000, w);
+
+          ctx.strokeStyle = '#00ff00';
+          ctx.lineWidth = 2;
+          ctx.shadowBlur = 8;
+          ctx.shadowColor = '#00ff00';
+
+          while (sweepCarry >= SWEEP_STEP_PX) {
+            sweepCarry -= SWEEP_STEP_PX;
+            const y = nextWaveY(h, now);
+
+            if (sweepX + SWEEP_STEP_PX > w) {
+              sweepX = 0;
+              sweepLastY = null;
+            }
+            const x1 = sweepX + SWEEP_STEP_PX;
+
+            // Erase bar ahead of the pen; clearRect lets the CSS grid show through
+            ctx.clearRect(x1 + 1, 0, SWEEP_ERASE_PX, h);
+            if (x1 + 1 + SWEEP_ERASE_PX > w) {
+              ctx.clearRect(0, 0, x1 + 1 + SWEEP_ERASE_PX - w, h);
+            }
+
+            ctx.beginPath();
+            ctx.moveTo(sweepX, sweepLastY === null ? y : sweepLastY);
+            ctx.lineTo(x1, y);
+            ctx.stroke();
+
+            sweepX = x1;
+            sweepLastY = y;
+          }
         }
-        .print-btn:active {
-            transform: translate(2px, 2px);
-            box-shadow: 2px 2px 0 black;
+        sweepLastTs = ts;
+
+        // Frame time (EMA), shown twice a second
+        const frameMs = performance.now() - t0;
+        frameMsAvg = frameMsAvg * 0.95 + frameMs * 0.05;
+        if (now - frameMsLastShown > 500) {
+          frameMsLastShown = now;
+          const el = document.getElementById('ecg-frame-ms');
+          if (el) el.textContent = frameMsAvg.toFixed(2);
         }
-    </style>
-</head>
-<body>
-    <div class="report-container">
-        <div class="header">
-            <h1>❤️ Patient Ventilation Report</h1>
-            <div class="subtitle">AutoVent AI System - Medical Data Summary</div>
-        </div>
-        
-        <div class="meta-info">
-            <div class="meta-item">
-                <div class="meta-label">Report Generated</div>
-                <div class="meta-value">${new Date().toLocaleString()}</div>
-            </div>
-            <div class="meta-item">
-                <div class="meta-label">Data Duration</div>
-                <div class="meta-value">${duration.toUpperCase()} • ${validCount} Readings</div>
-            </div>
-        </div>
-        
-        <div class="section">
-            <h2 class="section-title">📊 Statistical Summary</h2>
-            <div class="stats-grid">
-                <div class="stat-card">
-                    <div class="label">Oxygen Saturation (SpO2)</div>
-                    <div class="value c-spo2">${spo2Avg}<span style="font-size:1rem">%</span></div>
-                    <div class="range">Range: ${spo2Min.toFixed(1)}% - ${spo2Max.toFixed(1)}%</div>
-                </div>
-                <div class="stat-card">
-                    <div class="label">Heart Rate</div>
-                    <div class="value c-hr">${hrAvg}<span style="font-size:1rem">BPM</span></div>
-                    <div class="range">Range: ${hrMin.toFixed(0)} - ${hrMax.toFixed(0)} BPM</div>
-                </div>
-                <div class="stat-card">
-                    <div class="label">Body Temperature</div>
-                    <div class="value c-temp">${tempAvg}<span style="font-size:1rem">°F</span></div>
-                    <div class="range">Range: ${tempMin.toFixed(1)}°F - ${tempMax.toFixed(1)}°F</div>
-                </div>
-                <div class="stat-card">
-                    <div class="label">Ventilation Rate</div>
-                    <div class="value c-vent">${bpmAvg}<span style="font-size:1rem">BPM</span></div>
-                    <div class="range">Range: ${bpmMin} - ${bpmMax} BPM</div>
-                </div>
-            </div>
-        </div>
         
-        <div class="section">
-            <h2 class="section-title">📋 Detailed Data Log</h2>
-            <table>
-                <thead>
-                    <tr>
-                        ${pdfData[0].map(header => '<th>' + header + '</th>').join('')}
-                    </tr>
-                </thead>
-                <tbody>
-                    ${pdfData.slice(1).map(row => 
-                        '<tr>' + row.map(cell => '<td>' + cell + '</td>').join('') + '</tr>'
-                    ).join('')}
-                </tbody>
-            </table>
-        </div>
+        requestAnimationFrame(drawECG);
+      }
+
+      // Start ECG animation
+      lastHeartBeat = Date.now();
+      requestAnimationFrame(drawECG);
+
+        // Live table uses a fixed pool of rows. Each poll moves the oldest row
+        // to the top and rewrites its six cells; nothing is created or parsed.
+        const maxHistoryItems = 10;
+        const sensorRowColumns = ['col-time', 'col-spo2', 'col-hr', 'col-temp', 'col-vent', 'col-status'];
+        let sensorRowsReady = false;
+        let newestSensorRow = null;
+
+        function initSensorRows(tbody) {
+            const placeholder = document.getElementById('sensor-data-placeholder');
+            if (placeholder) tbody.removeChild(placeholder);
+            for (let i = 0; i < maxHistoryItems; i++) {
+                const row = document.createElement('tr');
+                row.className = 'empty';
+                sensorRowColumns.forEach(c => {
+                    const td = document.createElement('td');
+                    td.className = c;
+                    row.appendChild(td);
+                });
+                tbody.appendChild(row);
+            }
+            sensorRowsReady = true;
+        }
+
+        function updateSensorDataTable(data) {
+            const tbody = document.getElementById('sensor-data-table');
+            if (!sensorRowsReady) initSensorRows(tbody);
+
+            const row = tbody.lastElementChild;
+            tbody.insertBefore(row, tbody.firstElementChild);
+
+            const cells = row.children;
+            cells[0].textContent = new Date().toLocaleTimeString();
+            cells[1].textContent = data.spo2 ? data.spo2.toFixed(1) : '--';
+            cells[2].textContent = data.hr ? data.hr.toFixed(0) : '--';
+            cells[3].textContent = data.temp_f ? data.temp_f.toFixed(1) : '--';
+            cells[4].textContent = data.target_bpm || '--';
+            cells[5].textContent = data.sensor_ok ? '✓ Online' : '✗ Offline';
+
+            if (newestSensorRow) newestSensorRow.className = '';
+            row.className = 'newest';
+            newestSensorRow = row;
+        }
+
+        // Skips DOM writes whose value hasn't changed since the last poll
+        const domCache = {};
+        function setText(id, text) {
+            if (domCache[id] === text) return;
+            domCache[id] = text;
+            document.getElementById(id).textContent = text;
+        }
+        function setStyle(id, prop, value) {
+            const key = id + '.' + prop;
+            if (domCache[key] === value) return;
+            domCache[key] = value;
+            document.getElementById(id).style[prop] = value;
+        }
+
+        // All per-poll DOM writes happen here, once per animation frame
+        function renderStatus(d) {
+            setText('ppg-mode', d.ppg && d.ppg.length > 0 ? '(Real Sensor Data)' : '(Simulated)');
+            setText('spo2', d.spo2 ? d.spo2.toFixed(1) : '--');
+            setText('hr', d.hr ? d.hr.toFixed(0) : '--');
+            setText('ecg-hr', d.hr && d.hr > 0 ? d.hr.toFixed(0) : '--');
+            setText('temp', (d.temp_f === null || d.temp_f === undefined) ? '--' : d.temp_f.toFixed(1));
+
+            const bpm = d.target_bpm || 0;
+            setText('bpm', String(bpm));
+            // Animate Breath
+            if (bpm > 0) setStyle('breath-anim', 'animationDuration', (60 / bpm) + 's');
+
+            // Status
+            setText('status', d.sensor_ok ? 'System Online' : 'Connecting Sensor...');
+            setStyle('status', 'background', d.sensor_ok ? 'var(--green)' : 'var(--red)');
+
+            // Mode
+            setText('mode-badge', d.manual_mode ? 'Manual Override' : 'Auto');
+            setStyle('mode-badge', 'background', d.manual_mode ? 'var(--red)' : 'var(--yellow)');
+            setStyle('mode-badge', 'color', d.manual_mode ? 'white' : 'black');
+
+            // Alarm: latched alarms stay on screen until acknowledged
+            setStyle('alarm-indicator', 'display', d.alarm_active ? 'block' : 'none');
+
+            updateSensorDataTable(d);
+        }
+
+        let pendingStatus = null;
+        function scheduleRender(d) {
+            const first = pendingStatus === null;
+            pendingStatus = d;
+            if (first) {
+                requestAnimationFrame(() => {
+                    const latest = pendingStatus;
+                    pendingStatus = null;
+                    renderStatus(latest);
+                });
+            }
+        }
+
+        function setSim(v) { fetch('/set_spo2?val='+v); }
         
-        <div class="footer">
-            <strong>⚠️ DISCLAIMER:</strong> This is a demonstration/hobby device. 
-            Not for clinical or medical use. Data provided for educational purposes only.
-            <br><br>
-            Generated by AutoVent AI System • DIY Ventilator Project
-        </div>
-    </div>
-    
-    <button class="print-btn no-print" onclick="window.print()">🖨️ Print Report</button>
-</body>
-</html>`;
-                    
-                    // Download as HTML file
-                    const blob = new Blob([reportHtml], { type: 'text/html' });
-                    const url = URL.createObjectURL(blob);
-                    const a = document.createElement('a');
-                    a.href = url;
-                    a.download = 'ventilation_report_' + duration + '_' + Date.now() + '.html';
-                    document.body.appendChild(a);
-                    a.click();
-                    document.body.removeChild(a);
-                    URL.revokeObjectURL(url);
+        async function loop() {
+            try {
+                const r = await fetch('/status');
+                const d = await r.json();
+                
+                // Update PPG data buffer for real waveform display
+                if (d.ppg && Array.isArray(d.ppg) && d.ppg.length > 0) {
+                    ppgDataBuffer = d.ppg;
+                    ppgDisplayIndex = 0;
+                }
+                
+                if (d.hr && d.hr > 0) {
+                    currentHR = d.hr;
+                }
+                
+                // Trigger ECG wave when beat is detected (fallback for simulated mode)
+                if (d.beat_detected && !beatDetected) {
+                    beatDetected = true;
+                    beatStartTime = Date.now();
+                }
+
+                // Alarm sound; acknowledging silences it
+                const alarmSounding = d.alarm_active && !d.alarm_acked;
+                if(alarmSounding) {
+                    // Play sound when alarm becomes active
+                    if (!lastAlarmState) {
+                        console.log('🔊 Triggering alarm sound...');
+                        playAlarmSound();
+                        // Also show browser notification if supported
+                        if ('Notification' in window && Notification.permission === 'granted') {
+                            new Notification('⚠️ CRITICAL ALERT', {
+                                body: 'Patient vitals require immediate attention!',
+                                icon: 'data:image/svg+xml,<svg xmlns="http://www.w3.org/2000/svg" viewBox="0 0 100 100"><text y="70" font-size="70">⚠️</text></svg>',
+                                requireInteraction: true
+                            });
+                        }
+                    }
+                } else {
+                    // Stop sound when alarm clears or is acknowledged
+                    if (lastAlarmState) {
+                        console.log('✓ Alarm cleared - stopping sound');
+                        stopAlarmSound();
+                    }
+                }
+                lastAlarmState = alarmSounding;
+                
+                scheduleRender(d);
+              } catch (e) {
+              }
+            }
+
+            async function setBpm() {
+                const password = document.getElementById('bpm-password').value;
+                const bpm = document.getElementById('bpm-value').value;
+                const resultDiv = document.getElementById('bpm-result');
+                
+                if (!password || !bpm) {
+                    resultDiv.textContent = '❌ Please enter both password and BPM value';
+                    resultDiv.style.color = 'red';
+                    return;
+                }
+                
+                try {
+                    const r = await fetch('/set_bpm?password=' + encodeURIComponent(password) + '&bpm=' + encodeURIComponent(bpm));
+                    const text = await r.text();
                     
+                    if (r.ok) {
+                        resultDiv.textContent = '✅ ' + text;
+                        resultDiv.style.color = 'green';
+                        document.getElementById('bpm-password').value = '';
+                        document.getElementById('bpm-value').value = '';
+                    } else {
+                        resultDiv.textContent = '❌ ' + text;
+                        resultDiv.style.color = 'red';
+                    }
                 } catch (e) {
-                    alert('Error: ' + e.message);
+                    resultDiv.textContent = '❌ Error: ' + e.message;
+                    resultDiv.style.color = 'red';
                 }
             }
 
-            setInterval(loop, 500);
-            loop();
-          </script>
-        </body>
-        </html>
-        )raw";
+            // Report parsing/building runs in a worker so the waveform and alarm
+            // rendering keep full frame rate during a long export.
+            // One shared worker; replies are matched to requests by id.
+            let reportWorker = null;
+            let reportNextId = 1;
+            const reportPending = new Map(); // id -> duration
+            function getReportWorker() {
+                if (!reportWorker) {
+                    const src = document.getElementById('report-worker').textContent;
+                    const url = URL.createObjectURL(new Blob([src], { type: 'text/javascript' }));
+                    reportWorker = new Worker(url);
+                    URL.revokeObjectURL(url);
+                    reportWorker.onmessage = onReportMessage;
+                }
+                return reportWorker;
+            }
+
+            function onReportMessage(ev) {
+                const { id, blob, error } = ev.data;
+                if (!reportPending.has(id)) return;
+                const duration = reportPending.get(id);
+                reportPending.delete(id);
+                if (error) {
+                    alert(error);
+                    return;
+                }
+                // Download as HTML file
+                const url = URL.createObjectURL(blob);
+                const a = document.createElement('a');
+                a.href = url;
+                a.download = 'ventilation_report_' + duration + '_' + Date.now() + '.html';
+                document.body.appendChild(a);
+                a.click();
+                document.body.removeChild(a);
+                URL.revokeObjectURL(url);
+            }
+
+            function downloadData(duration) {
+                const worker = getReportWorker();
+                const id = reportNextId++;
+                reportPending.set(id, duration);
+                // Blob workers have no hierarchical base URL, so pass an absolute one
+                worker.postMessage({
+                    id: id,
+                    url: new URL('/get_data?duration=' + duration, location.href).href,
+                    duration: duration
+                });
+            }
+
+            // Anchor the device clock so exports carry real timestamps
+            fetch('/set_time?epoch_ms=' + Date.now() + '&tz_offset_min=' + new Date().getTimezoneOffset());
+
+            setInterval(loop, 500);
+            loop();
+          </script>
+        </body>
+        </html>
+        )raw";
+
+          g_server.send(200, "text/html", html);
+}
+
+// DS18B20 ROM address as 16 hex digits, family code first
+String probeAddrString(const uint8_t* a) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%02X%02X%02X%02X%02X%02X%02X%02X",
+           a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+  return String(buf);
+}
+
+void handleStatus() {
+  const ControlSnapshot snap = readSnapshot();
+  const Telemetry& t = snap.t;
+  const SensorSnapshot sensor = readSensorSnapshot();
+  String json;
+  json.reserve(320);
+  json += "{";
+  json += "\"sensor_ok\":";
+  json += (t.sensorOk ? "true" : "false");
+  json += ",\"manual_mode\":";
+  json += (g_manualMode ? "true" : "false");
+  json += ",\"target_bpm\":";
+  json += String(t.targetBpm);
+  json += ",\"bpm_control\":{\"spo2_filtered\":";
+  json += isnan(snap.bpmCtl.spo2Ema) ? String("null") : String(snap.bpmCtl.spo2Ema, 2);
+  json += ",\"bpm\":";
+  json += String(snap.bpmCtl.bpm, 2);
+  json += "}";
+
+  json += ",\"spo2\":";
+  if (isnan(t.spo2)) {
+    json += "null";
+  } else {
+    json += String(t.spo2, 1);
+  }
+
+  json += ",\"hr\":";
+  if (isnan(t.heartRate)) {
+    json += "null";
+  } else {
+    json += String(t.heartRate, 1);
+  }
+
+  json += ",\"temp_c\":";
+  if (isnan(t.tempC)) {
+    json += "null";
+  } else {
+    json += String(t.tempC, 1);
+  }
+
+  json += ",\"temp_f\":";
+  if (isnan(t.tempC)) {
+    json += "null";
+  } else {
+    json += String(t.tempC * 9.0f / 5.0f + 32.0f, 1);
+  }
+
+  json += ",\"alarm_active\":";
+  json += (snap.alarmActive ? "true" : "false");
+  json += ",\"alarm_acked\":";
+  json += (snap.alarmAcked ? "true" : "false");
+  json += ",\"alarm_priority\":";
+  json += String(static_cast<int>(snap.alarmPriority));
+  json += ",\"alarms\":[";
+  bool firstAlarm = true;
+  for (size_t i = 0; i < kAlarmCount; i++) {
+    if (!(snap.alarmMask & (1UL << i))) continue;
+    if (!firstAlarm) json += ",";
+    firstAlarm = false;
+    json += "\"";
+    json += kAlarmRules[i].name;
+    json += "\"";
+  }
+  json += "]";
+  json += ",\"alarm_latency_us_max\":";
+  json += String(g_alarmLatencyUsMax);
+  json += ",\"alarm_eval_cycles_max\":";
+  json += String(g_alarmEvalCyclesMax);
+  json += ",\"journal_flush_us_max\":";
+  json += String(g_alarmJournalFlushUsMax);
+  json += ",\"settings_save_us_max\":";
+  json += String(g_settingsSaveUsMax);
+
+  json += ",\"beat_detected\":";
+  json += (t.beatDetected ? "true" : "false");
+
+  json += ",\"servo_peak_slew\":";
+  json += String(t.peakSlewDegPerSec, 1);
+  json += ",\"servo_slew_violations\":";
+  json += String(t.slewViolations);
+
+  if (kServoFeedbackEnabled) {
+    const float n = t.trackSamples > 0 ? static_cast<float>(t.trackSamples) : 1.0f;
+    json += ",\"servo_track_err_mean\":";
+    json += String(t.trackErrAbsSum / n, 2);
+    json += ",\"servo_track_err_rms\":";
+    json += String(sqrtf(t.trackErrSqSum / n), 2);
+    json += ",\"servo_track_err_max\":";
+    json += String(t.trackErrMax, 2);
+    json += ",\"servo_stall\":";
+    json += (t.servoStall ? "true" : "false");
+  }
+
+  if (kFlowSensorEnabled) {
+    json += ",\"flow_ml_s\":";
+    json += String(snap.flow.flowUlPerSec / 1000);
+    json += ",\"tidal_volume_ml\":";
+    json += snap.volume.lastTidalMl < 0 ? String("null") : String(snap.volume.lastTidalMl);
+    json += ",\"tidal_volume_target_ml\":";
+    json += String(kVolumePid.targetMl);
+    json += ",\"peak_angle\":";
+    json += String(snap.volume.peakQ8 / 256.0f, 1);
+    json += ",\"flow_samples\":";
+    json += String(snap.flow.samples);
+    json += ",\"flow_errors\":";
+    json += String(snap.flow.errors);
+    json += ",\"flow_cycles_max\":";
+    json += String(snap.flow.cyclesMax);
+    json += ",\"flow_budget_overruns\":";
+    json += String(snap.flow.budgetOverruns);
+  }
+
+  json += ",\"control_jitter_max_us\":";
+  json += String(g_controlJitterMaxUs);
+  json += ",\"control_jitter_hist\":[";
+  for (size_t i = 0; i < kJitterBucketCount; i++) {
+    if (i > 0) json += ",";
+    json += String(g_controlJitterHist[i]);
+  }
+  json += "]";
+
+  json += ",\"temp_probes\":[";
+  for (size_t i = 0; i < g_tempProbeCount; i++) {
+    if (i > 0) json += ",";
+    json += "{\"addr\":\"";
+    json += probeAddrString(g_tempProbeAddr[i]);
+    json += "\",\"alarm\":";
+    json += (i == g_alarmProbeIndex ? "true" : "false");
+    json += ",\"temp_c\":";
+    json += isnan(g_sharedProbeTempC[i]) ? String("null") : String(g_sharedProbeTempC[i], 1);
+    json += "}";
+  }
+  json += "]";
+  json += ",\"temp_alarm_probe\":";
+  if (g_alarmProbeKnown) {
+    json += "{\"addr\":\"";
+    json += probeAddrString(g_alarmProbeAddr);
+    json += "\",\"present\":";
+    json += (g_alarmProbeIndex < kMaxTempProbes ? "true" : "false");
+    json += "}";
+  } else {
+    json += "null";
+  }
+
+  json += ",\"oximeter\":{\"state\":\"";
+  json += kOxStateNames[static_cast<size_t>(sensor.ox.state)];
+  json += "\",\"steps\":";
+  json += String(sensor.ox.steps);
+  json += ",\"step_failures\":";
+  json += String(sensor.ox.stepFailures);
+  json += ",\"step_max_us\":";
+  json += String(sensor.ox.stepMaxUs);
+  json += ",\"backoff_ms\":";
+  json += String(sensor.ox.backoffMs);
+  json += ",\"bring_ups\":";
+  json += String(sensor.ox.bringUps);
+  json += "}";
+
+  json += ",\"signal_quality\":{\"sqi\":";
+  json += String(t.sqi);
+  json += ",\"perfusion_pct\":";
+  json += isnan(sensor.perfusionPct) ? String("null") : String(sensor.perfusionPct, 2);
+  json += ",\"correlation\":";
+  json += isnan(sensor.correlation) ? String("null") : String(sensor.correlation, 2);
+  json += ",\"dc_change\":";
+  json += isnan(sensor.dcChange) ? String("null") : String(sensor.dcChange, 3);
+  json += ",\"clipped\":";
+  json += (sensor.clippedWindow ? "true" : "false");
+  json += ",\"windows\":";
+  json += String(sensor.windows);
+  json += "}";
+
+  json += ",\"i2c\":{\"clock_hz\":";
+  json += String(kI2cClockHz);
+  json += ",\"recoveries\":";
+  json += String(g_i2cRecoveries);
+  json += ",\"devices\":[";
+  for (size_t i = 0; i < kI2cMaxDevices && g_i2cStats[i].address != 0; i++) {
+    const I2cDeviceStats& st = g_i2cStats[i];
+    char addr[5];
+    snprintf(addr, sizeof(addr), "0x%02X", st.address);
+    if (i > 0) json += ",";
+    json += "{\"addr\":\"";
+    json += addr;
+    json += "\",\"transactions\":";
+    json += String(st.transactions);
+    json += ",\"errors\":";
+    json += String(st.errors);
+    json += ",\"max_us\":";
+    json += String(st.maxUs);
+    json += ",\"busy_us\":";
+    json += u64ToString(readShared(st.busyUs));
+    json += "}";
+  }
+  json += "]}";
+
+  json += ",\"boot_us\":{";
+  for (size_t i = 0; i < kBootPhaseCount; i++) {
+    if (i > 0) json += ",";
+    json += "\"";
+    json += kBootPhaseNames[i];
+    json += "\":";
+    json += g_bootPhaseUs[i] == 0 ? String("null") : String(g_bootPhaseUs[i]);
+  }
+  json += "}";
+
+  // Add PPG waveform data array
+  json += ",\"ppg\":[";
+  if (t.ppgDataCount > 0) {
+    for (size_t i = 0; i < t.ppgDataCount; i++) {
+      if (i > 0) json += ",";
+      json += String(t.ppgData[i]);
+    }
+  }
+  json += "]";
+
+  json += "}";
+  g_server.send(200, "application/json", json);
+}
+
+void onBeatDetected() {
+  g_sharedBeatDetected = true;
+  g_sqi.beatPending = true; // Called from g_pox.update(), i.e. in TaskI2c
+  writeShared(g_sharedLastBeatUs, timebaseUs());
+}
+
+// --------------------------------------------------------------------------
+// I2C BUS (TaskI2c only)
+// --------------------------------------------------------------------------
+void i2cBegin() {
+  Wire.begin(kI2cSdaPin, kI2cSclPin, kI2cClockHz);
+  Wire.setTimeOut(kI2cTimeoutMs);
+}
+
+void i2cRecord(uint8_t address, bool ok, uint32_t us) {
+  I2cDeviceStats* st = nullptr;
+  for (I2cDeviceStats& slot : g_i2cStats) {
+    if (slot.address == address || slot.address == 0) {
+      st = &slot;
+      break;
+    }
+  }
+  if (st == nullptr) return;
+  st->address = address;
+  st->transactions++;
+  if (!ok) st->errors++;
+  if (us > st->maxUs) st->maxUs = us;
+  writeShared(st->busyUs, st->busyUs + us);
+}
+
+// A slave reset mid-byte can hold SDA low forever. Clock SCL by hand until
+// it lets go (at most 9 bits), issue a STOP, then restart the controller.
+void i2cRecoverBus() {
+  Wire.end();
+  pinMode(kI2cSdaPin, INPUT_PULLUP);
+  pinMode(kI2cSclPin, OUTPUT_OPEN_DRAIN);
+  for (int i = 0; i < 9 && digitalRead(kI2cSdaPin) == LOW; i++) {
+    digitalWrite(kI2cSclPin, LOW);
+    delayMicroseconds(5);
+    digitalWrite(kI2cSclPin, HIGH);
+    delayMicroseconds(5);
+  }
+  pinMode(kI2cSdaPin, OUTPUT_OPEN_DRAIN);
+  digitalWrite(kI2cSdaPin, LOW);
+  delayMicroseconds(5);
+  digitalWrite(kI2cSclPin, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(kI2cSdaPin, HIGH);
+  delayMicroseconds(5);
+  i2cBegin();
+  g_i2cRecoveries++;
+}
+
+// After a failed transaction: an idle bus has SDA high, so only a stuck
+// one pays for recovery
+void i2cCheckBus() {
+  if (digitalRead(kI2cSdaPin) == LOW) {
+    i2cRecoverBus();
+  }
+}
+
+bool i2cExecute(const I2cTransaction& t) {
+  if (t.txLen > 0) {
+    Wire.beginTransmission(t.address);
+    Wire.write(t.tx, t.txLen);
+    // Repeated start when a read follows (register address, then data)
+    if (Wire.endTransmission(t.rxLen == 0) != 0) return false;
+  }
+  if (t.rxLen > 0) {
+    if (Wire.requestFrom(static_cast<uint16_t>(t.address), t.rxLen, true) != t.rxLen) return false;
+    for (size_t i = 0; i < t.rxLen; i++) {
+      t.rx[i] = static_cast<uint8_t>(Wire.read());
+    }
+  }
+  return true;
+}
+
+// Queues a transaction without waiting; the caller polls t->done and must
+// keep *t (and its buffers) alive until then. False if the queue is full.
+bool i2cSubmit(I2cTransaction* t) {
+  t->ok = false;
+  t->done = false;
+  return xQueueSend(g_i2cQueue, &t, 0) == pdTRUE;
+}
+
+void serveI2cQueue() {
+  I2cTransaction* t = nullptr;
+  for (size_t n = 0; n < kI2cMaxQueuedPerPass && xQueueReceive(g_i2cQueue, &t, 0) == pdTRUE; n++) {
+    const uint32_t startUs = micros();
+    t->ok = i2cExecute(*t);
+    i2cRecord(t->address, t->ok, micros() - startUs);
+    if (!t->ok) i2cCheckBus();
+    t->done = true; // *t may be reused by its owner from here on
+  }
+}
+
+// --------------------------------------------------------------------------
+// SIGNAL QUALITY (TaskI2c), scored by signal_quality.h
+// --------------------------------------------------------------------------
+void resetSignalQuality() {
+  g_sqi = SignalQuality();
+  g_sharedSqi = 0;
+}
+
+// Every raw sample (50 Hz)
+void addSqiSample(uint16_t ir, uint16_t red) {
+  if (ventilation::addSqiSample(g_sqi, kSqi, ir, red)) {
+    g_sharedSqi = g_sqi.score;
+  }
+}
+
+// --------------------------------------------------------------------------
+// OXIMETER BRING-UP
+// Runs from TaskI2c one step per pass, so an absent sensor costs at most
+// one short I2C timeout per attempt and never holds up PPG handling or
+// queued transactions. A failed step backs off exponentially and restarts from Probe;
+// a failed health check while Ready does the same.
+// --------------------------------------------------------------------------
+bool oximeterStep(OxState state) {
+  switch (state) {
+    case OxState::Probe:
+      Wire.beginTransmission(MAX30100_I2C_ADDRESS);
+      return Wire.endTransmission() == 0;
+    case OxState::PartId:
+    case OxState::Ready:
+      return g_max30100.getPartId() == EXPECTED_PART_ID;
+    case OxState::PoxBegin:
+      // The library's begin() is a handful of register writes; only reached
+      // once the part has answered, so none of them wait out a timeout
+      if (!g_pox.begin()) return false;
+      g_pox.setOnBeatDetectedCallback(onBeatDetected);
+      return true;
+    case OxState::RawMode:
+      g_max30100.setMode(MAX30100_MODE_SPO2_HR);
+      return true;
+    case OxState::RawPulseWidth:
+      g_max30100.setLedsPulseWidth(MAX30100_SPC_PW_1600US_16BITS);
+      return true;
+    case OxState::RawSampleRate:
+      g_max30100.setSamplingRate(MAX30100_SAMPRATE_100HZ);
+      return true;
+    case OxState::RawLedCurrent:
+      g_max30100.setLedsCurrent(MAX30100_LED_CURR_50MA, MAX30100_LED_CURR_27_1MA);
+      return true;
+  }
+  return false;
+}
 
-          g_server.send(200, "text/html", html);
+void pollOximeter(uint32_t now) {
+  if (static_cast<int32_t>(now - g_ox.nextStepMs) < 0) return;
+
+  const OxState state = g_ox.state;
+  const uint32_t startUs = micros();
+  const bool ok = oximeterStep(state);
+  const uint32_t stepUs = micros() - startUs;
+  i2cRecord(MAX30100_I2C_ADDRESS, ok, stepUs);
+  if (!ok && state != OxState::Probe) i2cCheckBus();
+  g_ox.steps++;
+  if (stepUs > g_ox.stepMaxUs) {
+    g_ox.stepMaxUs = stepUs;
+  }
+
+  if (ok && state == OxState::Ready) {
+    g_ox.nextStepMs = now + kOximeterHealthCheckMs;
+    return;
+  }
+  if (!ok) {
+    g_ox.stepFailures++;
+    if (state == OxState::Ready) {
+      g_sharedSensorOk = false;
+      g_sharedSpo2 = NAN;
+      g_sharedHr = NAN;
+      resetSignalQuality();
+      Serial.println("[Task] Sensor lost, reconnecting");
+    }
+    g_ox.state = OxState::Probe;
+    g_ox.nextStepMs = now + g_ox.backoffMs;
+    g_ox.backoffMs = std::min(g_ox.backoffMs * 2, kOximeterBackoffMaxMs);
+    return;
+  }
+
+  g_ox.state = static_cast<OxState>(static_cast<uint8_t>(state) + 1);
+  g_ox.nextStepMs = now; // Next step on the next pass
+  if (g_ox.state == OxState::Ready) {
+    g_ox.backoffMs = kOximeterBackoffMinMs;
+    g_ox.bringUps++;
+    g_ox.nextStepMs = now + kOximeterHealthCheckMs;
+    g_sharedSensorOk = true;
+    markBootPhase(kBootSensor);
+    Serial.println("[Task] Sensor Init SUCCESS");
+  }
 }
 
-void handleStatus() {
-  String json;
-  json.reserve(320);
-  json += "{";
-  json += "\"sensor_ok\":";
-  json += (g_t.sensorOk ? "true" : "false");
-  json += ",\"manual_mode\":";
-  json += (g_manualMode ? "true" : "false");
-  json += ",\"target_bpm\":";
-  json += String(g_t.targetBpm);
+bool initServoFeedback() {
+  adc_digi_init_config_t initCfg = {};
+  initCfg.max_store_buf_size = 1024;
+  initCfg.conv_num_each_intr = 256;
+  initCfg.adc1_chan_mask = BIT(kServoFeedbackChannel);
+  if (adc_digi_initialize(&initCfg) != ESP_OK) {
+    return false;
+  }
 
-  json += ",\"spo2\":";
-  if (isnan(g_t.spo2)) {
-    json += "null";
-  } else {
-    json += String(g_t.spo2, 1);
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = kServoFeedbackChannel;
+  pattern.unit = 0; // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t digCfg = {};
+  digCfg.conv_limit_en = true;
+  digCfg.conv_limit_num = 250;
+  digCfg.pattern_num = 1;
+  digCfg.adc_pattern = &pattern;
+  digCfg.sample_freq_hz = kServoFeedbackSampleHz;
+  digCfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  digCfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&digCfg) != ESP_OK) {
+    return false;
   }
+  return adc_digi_start() == ESP_OK;
+}
 
-  json += ",\"hr\":";
-  if (isnan(g_t.heartRate)) {
-    json += "null";
-  } else {
-    json += String(g_t.heartRate, 1);
+// Drains whatever the DMA engine has collected (never blocks) and publishes
+// the averaged angle for the control loop.
+void pollServoFeedback() {
+  static uint8_t buf[256];
+  uint32_t len = 0;
+  if (adc_digi_read_bytes(buf, sizeof(buf), &len, 0) != ESP_OK || len == 0) {
+    return;
   }
 
-  json += ",\"temp_c\":";
-  if (isnan(g_t.tempC)) {
-    json += "null";
-  } else {
-    json += String(g_t.tempC, 1);
+  uint32_t sum = 0;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+    const adc_digi_output_data_t* p = reinterpret_cast<const adc_digi_output_data_t*>(&buf[i]);
+    if (p->type1.channel != kServoFeedbackChannel) continue;
+    sum += p->type1.data;
+    n++;
   }
+  if (n == 0) return;
 
-  json += ",\"temp_f\":";
-  if (isnan(g_t.tempC)) {
-    json += "null";
+  const float raw = static_cast<float>(sum) / static_cast<float>(n);
+  const float span = static_cast<float>(kFeedbackRawAtMaxAngle - kFeedbackRawAtMinAngle);
+  g_sharedServoFeedbackDeg = kMinAngle + (raw - kFeedbackRawAtMinAngle) * (kMaxAngle - kMinAngle) / span;
+}
+
+void syncTelemetry() {
+  // Sync shared variables to local telemetry
+  static uint32_t lastSpo2Seq = 0;
+  // An operator-set rate becomes the controller's starting point, so the
+  // next sample slews away from it instead of stepping back
+  const int seedBpm = g_bpmSeedRequest;
+  if (seedBpm != 0) {
+    g_bpmSeedRequest = 0;
+    ventilation::seedBpmController(g_bpmCtl, seedBpm);
+    g_sharedTargetBpm = seedBpm;
+  }
+  if (g_manualMode) {
+    // In manual mode, override sensor data
+    g_t.sensorOk = true;
+    g_t.spo2 = g_manualSpo2;
+    // We can keep the last known HR or just ignore it.
+    // The manual value goes through the same controller, so switching
+    // modes never steps the rate
+    g_sharedTargetBpm = ventilation::updateBpmController(g_bpmCtl, kBpmControl, g_manualSpo2, millis());
   } else {
-    json += String(g_t.tempC * 9.0f / 5.0f + 32.0f, 1);
+    // Normal sensor mode
+    g_t.sensorOk = g_sharedSensorOk;
+    g_t.spo2 = g_sharedSpo2;
+    g_t.heartRate = g_sharedHr;
+
+    // Once per new SpO2 reading; with no sensor data a /set_bpm value stands
+    const uint32_t seq = g_sharedSpo2Seq;
+    if (seq != lastSpo2Seq) {
+      lastSpo2Seq = seq;
+      if (g_t.sensorOk) {
+        g_sharedTargetBpm = ventilation::updateBpmController(g_bpmCtl, kBpmControl, g_t.spo2, millis());
+      }
+    }
   }
 
-  json += ",\"alarm_active\":";
-  json += (g_alarmActive ? "true" : "false");
+  // If BPM changed, update cycle duration
+  if (g_t.targetBpm != g_sharedTargetBpm) {
+    g_t.targetBpm = g_sharedTargetBpm;
+    recomputeCycle(g_t.targetBpm);
+  }
 
-  json += ",\"beat_detected\":";
-  json += (g_t.beatDetected ? "true" : "false");
+  g_t.sqi = g_sharedSqi;
 
-  // Add PPG waveform data array
-  json += ",\"ppg\":[";
-  if (g_t.ppgDataCount > 0) {
-    for (size_t i = 0; i < g_t.ppgDataCount; i++) {
-      if (i > 0) json += ",";
-      json += String(g_t.ppgData[i]);
+  // Always sync DS18B20 data
+  g_t.tempC = g_sharedTempC;
+  g_t.beatDetected = g_sharedBeatDetected;
+  g_t.lastBeatUs = readShared(g_sharedLastBeatUs);
+  
+  // Copy PPG waveform data if available
+  if (g_ppgDataReady) {
+    noInterrupts();
+    for (size_t i = 0; i < kPpgBufferSize; i++) {
+      g_t.ppgData[i] = g_ppgBuffer[i];
     }
+    g_t.ppgDataCount = kPpgBufferSize;
+    interrupts();
   }
-  json += "]";
+  
+  // Reset beat flag after reading
+  if (g_sharedBeatDetected) {
+    g_sharedBeatDetected = false;
+  }
+}
 
-  json += "}";
-  g_server.send(200, "application/json", json);
+void recordControlJitter(uint32_t periodUs) {
+  const uint32_t expectedUs = kControlPeriodMs * 1000;
+  const uint32_t jitterUs = periodUs > expectedUs ? periodUs - expectedUs : expectedUs - periodUs;
+  size_t bucket = 0;
+  while (bucket < kJitterBucketCount - 1 && jitterUs >= kJitterBucketUs[bucket]) {
+    bucket++;
+  }
+  g_controlJitterHist[bucket]++;
+  if (jitterUs > g_controlJitterMaxUs) {
+    g_controlJitterMaxUs = jitterUs;
+  }
 }
 
-void onBeatDetected() {
-  g_sharedBeatDetected = true;
-  g_sharedLastBeatMs = millis();
+// --------------------------------------------------------------------------
+// CENTRAL STATION TELEMETRY
+// Fixed-size little-endian frame; layout mirrored by
+// tools/central_station/telemetry_frame.py. Bump the version on any change.
+// --------------------------------------------------------------------------
+constexpr uint32_t kTelemetryMagic = 0x4C545644; // "DVTL"
+constexpr uint8_t kTelemetryVersion = 2;
+
+enum TelemetryFlag : uint8_t {
+  kTelemetryRunning = 1 << 0,
+  kTelemetryManual = 1 << 1,
+  kTelemetrySensorOk = 1 << 2,
+  kTelemetryAlarm = 1 << 3,
+  kTelemetryAlarmAcked = 1 << 4,
+  kTelemetryWallClock = 1 << 5, // timeMs is epoch ms, else uptime ms
+};
+
+struct __attribute__((packed)) TelemetryFrame {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint16_t bedId;
+  uint32_t seq;
+  uint64_t timeMs;
+  float spo2;       // NAN when missing
+  float heartRate;
+  float tempF;
+  float servoAngle;
+  uint16_t targetBpm;
+  uint8_t alarmPriority;
+  uint8_t sqi;        // PPG signal quality 0-100 (since version 2)
+  uint32_t alarmMask; // Bit i = kAlarmRules[i] active
+};
+static_assert(sizeof(TelemetryFrame) == 44, "TelemetryFrame layout is part of the wire protocol");
+static_assert(kAlarmCount <= 32, "alarmMask holds one bit per rule");
+
+// Separate sequence per stream so each consumer sees a gap-free count
+uint32_t g_aggregatorSeq = 0;
+uint32_t g_multicastSeq = 0;
+WiFiClient g_aggregator;
+WiFiUDP g_multicastUdp;
+bool g_multicastReady = false;
+
+void buildTelemetryFrame(TelemetryFrame& f, uint32_t seq) {
+  const ControlSnapshot snap = readSnapshot();
+  const Telemetry& t = snap.t;
+  uint8_t flags = 0;
+  if (g_ventilatorRunning) flags |= kTelemetryRunning;
+  if (g_manualMode) flags |= kTelemetryManual;
+  if (t.sensorOk) flags |= kTelemetrySensorOk;
+  if (snap.alarmActive) flags |= kTelemetryAlarm;
+  if (snap.alarmAcked) flags |= kTelemetryAlarmAcked;
+  if (g_wallClockSet) flags |= kTelemetryWallClock;
+
+  f.magic = kTelemetryMagic;
+  f.version = kTelemetryVersion;
+  f.flags = flags;
+  f.bedId = kBedId;
+  f.seq = seq;
+  f.timeMs = displayMs(timebaseUs());
+  f.spo2 = t.spo2;
+  f.heartRate = t.heartRate;
+  f.tempF = isnan(t.tempC) ? NAN : (t.tempC * 9.0f / 5.0f + 32.0f);
+  f.servoAngle = t.lastAngle;
+  f.targetBpm = static_cast<uint16_t>(t.targetBpm);
+  f.alarmPriority = static_cast<uint8_t>(snap.alarmPriority);
+  f.sqi = t.sqi;
+  f.alarmMask = snap.alarmMask;
 }
 
-bool initMax30100() {
-  Wire.begin(kI2cSdaPin, kI2cSclPin);
-  // Many modules work fine at 100k. You can try 400k if stable.
-  // Wire.setClock(400000);
+// Called from loop(). One TCP connection to the aggregator; a failed write
+// drops it and the next attempt waits kAggregatorRetryMs. The frame goes
+// straight to the socket with MSG_DONTWAIT: WiFiClient::write() retries
+// with select() timeouts and can hold loop() for seconds on a stalled peer.
+// If the send buffer cannot take the whole frame, the peer is not keeping
+// up, so the connection is dropped (a partial frame would break framing).
+void pushTelemetry() {
+  if (kAggregatorHost[0] == '\0' || WiFi.status() != WL_CONNECTED) return;
 
-  if (!g_pox.begin()) {
-    return false;
+  static uint32_t lastPushMs = 0;
+  static uint32_t lastConnectMs = 0;
+  const uint32_t now = millis();
+  if (now - lastPushMs < kTelemetryPushMs) return;
+
+  if (!g_aggregator.connected()) {
+    if (lastConnectMs != 0 && now - lastConnectMs < kAggregatorRetryMs) return;
+    lastConnectMs = now;
+    if (!g_aggregator.connect(kAggregatorHost, kAggregatorPort, kAggregatorConnectTimeoutMs)) return;
+    g_aggregator.setNoDelay(true);
+    Serial.println("Connected to aggregator");
   }
+  lastPushMs = now;
 
-  g_pox.setOnBeatDetectedCallback(onBeatDetected);
-  
-  // Initialize raw MAX30100 for PPG waveform
-  if (g_max30100.begin()) {
-    g_max30100.setMode(MAX30100_MODE_SPO2_HR);
-    g_max30100.setLedsPulseWidth(MAX30100_SPC_PW_1600US_16BITS);
-    g_max30100.setSamplingRate(MAX30100_SAMPRATE_100HZ);
-    g_max30100.setLedsCurrent(MAX30100_LED_CURR_50MA, MAX30100_LED_CURR_27_1MA);
-    Serial.println("Raw MAX30100 initialized for PPG waveform");
+  TelemetryFrame f;
+  buildTelemetryFrame(f, ++g_aggregatorSeq);
+  const ssize_t sent = send(g_aggregator.fd(), &f, sizeof(f), MSG_DONTWAIT);
+  if (sent != static_cast<ssize_t>(sizeof(f))) {
+    Serial.println(sent < 0 && errno == EAGAIN ? "Aggregator not draining, dropping connection"
+                                                : "Aggregator write failed");
+    g_aggregator.stop();
+  }
+}
+
+// Called from loop(). Sends on a fixed schedule; a late loop() sends once
+// and re-aligns rather than bursting to catch up. Listeners find loss from
+// gaps in seq.
+void broadcastTelemetry() {
+  if (!kMulticastEnabled) return;
+  if (kStaSsid[0] != '\0' && WiFi.status() != WL_CONNECTED) return;
+
+  if (!g_multicastReady) {
+    IPAddress group;
+    group.fromString(kMulticastGroup);
+    g_multicastReady = g_multicastUdp.beginMulticast(group, kMulticastPort);
+    if (!g_multicastReady) return;
+  }
+
+  static uint32_t nextSendMs = 0;
+  const uint32_t now = millis();
+  if (static_cast<int32_t>(now - nextSendMs) < 0) return;
+  nextSendMs += kMulticastIntervalMs;
+  if (static_cast<int32_t>(now - nextSendMs) >= 0) {
+    nextSendMs = now + kMulticastIntervalMs;
+  }
+
+  TelemetryFrame f;
+  buildTelemetryFrame(f, ++g_multicastSeq);
+  g_multicastUdp.beginMulticastPacket();
+  g_multicastUdp.write(reinterpret_cast<const uint8_t*>(&f), sizeof(f));
+  g_multicastUdp.endPacket();
+}
+
+// --------------------------------------------------------------------------
+// CONTROL TASK (Core 1)
+// Fixed-period breathing trajectory, alarms and telemetry sync
+// --------------------------------------------------------------------------
+void publishSnapshot() {
+  uint32_t mask = 0;
+  for (size_t i = 0; i < kAlarmCount; i++) {
+    if (g_alarms[i].active) mask |= 1UL << i;
+  }
+  portENTER_CRITICAL(&g_snapshotMux);
+  g_snapshot.t = g_t;
+  g_snapshot.bpmCtl = g_bpmCtl;
+  g_snapshot.alarmActive = g_alarmActive;
+  g_snapshot.alarmAcked = g_alarmAcked;
+  g_snapshot.alarmPriority = g_alarmPriority;
+  g_snapshot.alarmMask = mask;
+  g_snapshot.flow = g_flow;
+  g_snapshot.volume = g_volume;
+  portEXIT_CRITICAL(&g_snapshotMux);
+}
+
+void TaskControl(void *pvParameters) {
+  Serial.println("Control Task Started on Core 1");
+
+  TickType_t lastWake = xTaskGetTickCount();
+  uint32_t lastTickUs = 0;
+
+  for (;;) {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(kControlPeriodMs));
+
+    const uint32_t nowUs = micros();
+    if (lastTickUs != 0) {
+      recordControlJitter(nowUs - lastTickUs);
+    }
+    lastTickUs = nowUs;
+
+    syncTelemetry();
+    updateBreathing();
+    checkAlarms();
+    logPatientData();
+    publishSnapshot();
   }
-  
-  return true;
 }
 
 void initWifiApAndServer() {
-  WiFi.mode(WIFI_AP);
+  const bool station = kStaSsid[0] != '\0';
+  WiFi.mode(station ? WIFI_AP_STA : WIFI_AP);
   WiFi.softAP(kApSsid, kApPassword);
   const IPAddress ip = WiFi.softAPIP();
+  markBootPhase(kBootWifi);
 
   Serial.print("Hotspot SSID: ");
   Serial.println(kApSsid);
   Serial.print("Open: http://");
   Serial.println(ip);
 
+  if (station) {
+    // Connects in the background; pushTelemetry() waits for WL_CONNECTED
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(kStaSsid, kStaPassword);
+    Serial.print("Joining network: ");
+    Serial.println(kStaSsid);
+  }
+
   g_server.on("/", handleRoot);
   g_server.on("/set_zero", handleSetZero);
   g_server.on("/start", handleStart);
@@ -1625,117 +3911,289 @@ void initWifiApAndServer() {
   g_server.on("/set_auto", handleSetAuto);
   g_server.on("/set_bpm", handleSetBpm);
   g_server.on("/get_data", handleGetData);
+  g_server.on("/ack_alarm", handleAckAlarm);
+  g_server.on("/alarms", handleAlarms);
+  g_server.on("/breaths", handleBreaths);
+  g_server.on("/stats", handleStats);
+  g_server.on("/set_time", handleSetTime);
   g_server.begin();
+  markBootPhase(kBootServer);
+}
+
+// --------------------------------------------------------------------------
+// TEMPERATURE PROBES
+// Addresses are found once by a bus search. Each round broadcasts one
+// skip-ROM convert to every probe, waits out the conversion, then reads one
+// probe's scratchpad by address per TaskSensor pass. No per-read searches,
+// and all probes sample the same instant.
+// --------------------------------------------------------------------------
+struct TempBus {
+  uint32_t roundStartMs = 0;
+  uint32_t lastScanMs = 0;
+  size_t readIndex = 0;
+  bool converting = false;
+  bool rescanPending = false; // A match-ROM read failed; search the bus after this round
+};
+
+TempBus g_tempBus;
+
+void scanTempProbes() {
+  g_tempBus.lastScanMs = millis();
+  g_tempBus.rescanPending = false;
+  g_ds18b20.begin(); // Bus search
+  const size_t found = std::min<size_t>(g_ds18b20.getDeviceCount(), kMaxTempProbes);
+  DeviceAddress addr[kMaxTempProbes];
+  size_t count = 0;
+  for (size_t i = 0; i < found; i++) {
+    if (!g_ds18b20.getAddress(addr[count], i)) continue;
+    g_ds18b20.setResolution(addr[count], kTempResolutionBits);
+    count++;
+  }
+
+  const size_t previous = g_tempProbeCount;
+  bool changed = count != previous;
+  g_tempProbeCount = 0; // Hide the list from /status while it is rewritten
+  for (size_t i = 0; i < count; i++) {
+    if (i < previous && memcmp(addr[i], g_tempProbeAddr[i], sizeof(DeviceAddress)) == 0) continue;
+    memcpy(g_tempProbeAddr[i], addr[i], sizeof(DeviceAddress));
+    g_sharedProbeTempC[i] = NAN; // A different probe now holds this slot
+    changed = true;
+  }
+  if (!g_alarmProbeKnown && count > 0) {
+    memcpy(g_alarmProbeAddr, addr[0], sizeof(DeviceAddress));
+    g_alarmProbeKnown = true;
+  }
+  size_t alarmIndex = kMaxTempProbes;
+  for (size_t i = 0; i < count && g_alarmProbeKnown; i++) {
+    if (memcmp(addr[i], g_alarmProbeAddr, sizeof(DeviceAddress)) == 0) alarmIndex = i;
+  }
+  if (alarmIndex != g_alarmProbeIndex) {
+    if (alarmIndex == kMaxTempProbes) {
+      g_sharedTempC = NAN; // No fresh samples either, so temp_stale raises
+      Serial.println("DS18B20 alarm probe missing");
+    }
+    changed = true;
+  }
+  g_alarmProbeIndex = alarmIndex;
+  g_tempProbeCount = count;
+  if (changed) {
+    Serial.print("DS18B20 probes found: ");
+    Serial.println(count);
+  }
+}
+
+void initTempProbes() {
+  g_ds18b20.setWaitForConversion(false);
+  scanTempProbes();
+}
+
+void pollTempProbes(uint32_t now) {
+  const size_t count = g_tempProbeCount;
+  if (count == 0) {
+    if (now - g_tempBus.lastScanMs >= kTempRescanMs) {
+      scanTempProbes();
+    }
+    return;
+  }
+
+  if (!g_tempBus.converting) {
+    // Between rounds: pick up added, removed or replaced probes
+    if (g_tempBus.rescanPending || now - g_tempBus.lastScanMs >= kTempFullRescanMs) {
+      scanTempProbes();
+      return;
+    }
+    if (now - g_tempBus.roundStartMs >= kTempPeriodMs) {
+      g_tempBus.roundStartMs = now;
+      g_ds18b20.requestTemperatures(); // Skip ROM + Convert T, returns immediately
+      g_tempBus.converting = true;
+      g_tempBus.readIndex = 0;
+    }
+    return;
+  }
+  if (now - g_tempBus.roundStartMs < kTempConvertMs) return;
+
+  const size_t i = g_tempBus.readIndex;
+  const float tC = g_ds18b20.getTempC(g_tempProbeAddr[i]); // Match ROM + read scratchpad
+  if (tC > -100.0f && tC < 150.0f) {
+    g_sharedProbeTempC[i] = tC;
+    if (i == g_alarmProbeIndex) {
+      g_sharedTempC = tC;
+      publishSample(g_sharedTempSampleUs);
+    }
+  } else {
+    g_tempBus.rescanPending = true; // Unplugged or replaced (getTempC() gives -127 C)
+  }
+
+  if (++g_tempBus.readIndex >= count) {
+    g_tempBus.converting = false;
+  }
 }
 
 // --------------------------------------------------------------------------
 // BACKGROUND SENSOR TASK (Core 0)
-// Independent loop that handles the blocking sensor restart & polling
+// 1-Wire temperature probes and servo feedback ADC (I2C lives in TaskI2c)
 // --------------------------------------------------------------------------
 void TaskSensor(void *pvParameters) {
   Serial.println("Sensor Task Started on Core 0");
 
-  // DS18B20 setup
-  g_ds18b20.begin();
-  g_ds18b20.setResolution(11);
-  g_ds18b20.setWaitForConversion(false);
-  uint32_t lastTempRequestMs = 0;
-  bool tempRequested = false;
-  
-  // Initial setup
-  g_sharedSensorOk = initMax30100();
-  
-  uint32_t lastReportMs = 0;
-  uint32_t lastRetryMs = 0;
+  initTempProbes();
 
+  bool feedbackOk = false;
+  if (kServoFeedbackEnabled) {
+    feedbackOk = initServoFeedback();
+    Serial.println(feedbackOk ? "Servo feedback ADC started" : "Servo feedback ADC init FAILED");
+  }
+  
   for (;;) {
     uint32_t now = millis();
 
-    // DS18B20 temperature (non-blocking)
-    if (!tempRequested) {
-      if (now - lastTempRequestMs >= 1000) {
-        lastTempRequestMs = now;
-        g_ds18b20.requestTemperatures();
-        tempRequested = true;
-      }
-    } else {
-      // With 11-bit resolution conversion is ~375ms max
-      if (now - lastTempRequestMs >= 400) {
-        const float tC = g_ds18b20.getTempCByIndex(0);
-        if (tC > -100.0f && tC < 150.0f) {
-          g_sharedTempC = tC;
-        }
-        tempRequested = false;
-      }
+    // DS18B20 temperatures (non-blocking, one bus operation per pass)
+    pollTempProbes(now);
+
+    if (feedbackOk) {
+      pollServoFeedback();
     }
+    
+    // Minimal yield to keep Core 0 responsive (WiFi/ISR)
+    vTaskDelay(pdMS_TO_TICKS(2)); 
+  }
+}
 
-    // 1. Update pulse oximeter frequently if sensor is OK
-    if (g_sharedSensorOk) {
-      g_pox.update();
+// --------------------------------------------------------------------------
+// I2C TASK (Core 0)
+// Sole owner of Wire. Each pass serves the oximeter first (its FIFO must be
+// drained every few ms), then up to kI2cMaxQueuedPerPass queued transactions
+// (the flow sensor's reads).
+// --------------------------------------------------------------------------
+void serviceOximeter(uint32_t now) {
+  static uint32_t lastPpgSampleMs = 0;
+  static uint32_t lastReportMs = 0;
 
-      // Capture raw PPG data for waveform display (every 20ms for ~50 Hz sampling)
-      static uint32_t lastPpgSampleMs = 0;
-      if (now - lastPpgSampleMs >= 20) {
-        lastPpgSampleMs = now;
-        
-        // Read raw IR value from sensor for PPG waveform
-        uint16_t ir, red;
-        g_max30100.update();
-        g_max30100.getRawValues(&ir, &red);
-        
-        // Store IR value in circular buffer (IR channel shows clearer pulse waveform)
-        g_ppgBuffer[g_ppgBufferIndex] = ir;
-        g_ppgBufferIndex = (g_ppgBufferIndex + 1) % kPpgBufferSize;
-        g_ppgDataReady = true;
-      }
+  static bool lastAckOk = true;
 
-      // 2. Refresh shared telemetry every 100ms
-      // This ensures the main loop (and web UI) sees fresh data without delay
-      if (now - lastReportMs > 100) {
-          lastReportMs = now;
-          float currentSpo2 = g_pox.getSpO2();
-          float currentHr = g_pox.getHeartRate();
-
-          // Only update if we have valid non-zero data (MAX30100 starts at 0)
-          // or if you want to show 0, remove the check. 
-          // Keeping > 0 preserves the "last known good" behavior or filters initial zeros.
-          if (currentSpo2 > 0.01f) {
-              g_sharedSpo2 = currentSpo2;
-              g_sharedHr = currentHr;
-              g_sharedTargetBpm = computeTargetBpm(currentSpo2);
-          }
-      }
-    } else {
-      // 3. Retry connection if sensor is lost/missing (Every 5s)
-      if (now - lastRetryMs > 5000) {
-          lastRetryMs = now;
-          Serial.println("[Task] Retrying Sensor Init...");
-          if (initMax30100()) {
-              g_sharedSensorOk = true;
-              Serial.println("[Task] Sensor Init SUCCESS");
-          }
+  const uint32_t startUs = micros();
+  g_pox.update();
+
+  // Capture raw PPG data for waveform display (every 20ms for ~50 Hz sampling)
+  if (now - lastPpgSampleMs >= 20) {
+    lastPpgSampleMs = now;
+
+    // The library ignores I2C errors and both it and g_pox drain the FIFO,
+    // so an empty getRawValues() proves nothing. An address ACK (~25 us at
+    // 400 kHz) tells whether the part is still answering.
+    Wire.beginTransmission(MAX30100_I2C_ADDRESS);
+    lastAckOk = Wire.endTransmission() == 0;
+    if (!lastAckOk) i2cCheckBus();
+    
+    // Read raw IR value from sensor for PPG waveform
+    uint16_t ir, red;
+    g_max30100.update();
+    g_max30100.getRawValues(&ir, &red);
+    
+    // Store IR value in circular buffer (IR channel shows clearer pulse waveform)
+    g_ppgBuffer[g_ppgBufferIndex] = ir;
+    g_ppgBufferIndex = (g_ppgBufferIndex + 1) % kPpgBufferSize;
+    g_ppgDataReady = true;
+    addSqiSample(ir, red);
+  }
+  // The library hides its transfers, so the whole call counts as one,
+  // failed if the last ACK check failed
+  i2cRecord(MAX30100_I2C_ADDRESS, lastAckOk, micros() - startUs);
+
+  // Refresh shared telemetry every 100ms
+  // This ensures the main loop (and web UI) sees fresh data without delay
+  if (now - lastReportMs > 100) {
+      lastReportMs = now;
+      float currentSpo2 = g_pox.getSpO2();
+      float currentHr = g_pox.getHeartRate();
+
+      // Only update if we have valid non-zero data (MAX30100 starts at 0)
+      // from a window of good signal quality. Otherwise the last good
+      // values are held: the rate controller sees no new reading, and
+      // spo2_stale raises once none has been accepted for 10 s.
+      // g_sharedSqi scores the last *completed* window, while getSpO2()
+      // already includes samples from the current one. So a bad stretch is
+      // caught up to one window (kSqi.windowSamples, 3 s) late, and a good
+      // one is released up to a window late.
+      if (currentSpo2 > 0.01f && g_sharedSqi >= kSqiGoodThreshold) {
+          g_sharedSpo2 = currentSpo2;
+          g_sharedHr = currentHr;
+          publishSpo2Sample(); // TaskControl derives the BPM from it
       }
+  }
+}
+
+void publishSensorSnapshot() {
+  portENTER_CRITICAL(&g_sensorSnapshotMux);
+  g_sensorSnapshot.ox = g_ox;
+  g_sensorSnapshot.perfusionPct = g_sqi.perfusionPct;
+  g_sensorSnapshot.correlation = g_sqi.correlation;
+  g_sensorSnapshot.dcChange = g_sqi.dcChange;
+  g_sensorSnapshot.clippedWindow = g_sqi.clippedWindow;
+  g_sensorSnapshot.windows = g_sqi.windows;
+  portEXIT_CRITICAL(&g_sensorSnapshotMux);
+}
+
+void TaskI2c(void *pvParameters) {
+  i2cBegin();
+
+  for (;;) {
+    const uint32_t now = millis();
+
+    if (g_sharedSensorOk) {
+      serviceOximeter(now);
     }
-    
-    // Minimal yield to keep Core 0 responsive (WiFi/ISR) but execute fast enough for 100Hz sampling
-    vTaskDelay(pdMS_TO_TICKS(2)); 
+    // Bring-up / reconnect / health check, one I2C step at most
+    pollOximeter(now);
+
+    serveI2cQueue();
+    publishSensorSnapshot();
+
+    vTaskDelay(pdMS_TO_TICKS(1));
   }
 }
 } // namespace
 
+// Fast boot: only what ventilation needs runs here (NVS settings, servo,
+// control task). The sensor comes up in its own task and Wi-Fi/HTTP from
+// the first loop(), so neither can delay the first breath.
 void setup() {
+  markBootPhase(kBootSetup);
   Serial.begin(115200);
-  delay(200);
 
-  pinMode(kBuzzerPin, OUTPUT);
-  digitalWrite(kBuzzerPin, LOW);
+  initBuzzer();
+  loadSettings();
+  ventilation::seedBpmController(g_bpmCtl, g_sharedTargetBpm);
+  loadAlarmJournal();
+  markBootPhase(kBootSettings);
 
   g_servo.setPeriodHertz(50);
-  g_servo.attach(kServoPin, 500, 2400);
-  g_servo.write(kMinAngle);
+  g_servo.attach(kServoPin, kServoMinPulseUs, kServoMaxPulseUs);
+  writeServoAngle(kMinAngle);
+  markBootPhase(kBootServo);
+
+  // Before TaskControl: it preempts setup() on this core, and a running
+  // ventilator restored from NVS submits flow reads on its first tick
+  g_i2cQueue = xQueueCreate(kI2cQueueDepth, sizeof(I2cTransaction*));
+  xTaskCreatePinnedToCore(
+    TaskI2c,
+    "I2cTask",
+    4096,
+    NULL,
+    kI2cTaskPriority,
+    NULL,
+    0);
+
+  xTaskCreatePinnedToCore(
+    TaskControl,
+    "ControlTask",
+    4096,
+    NULL,
+    kControlTaskPriority,
+    NULL,
+    1);
+  markBootPhase(kBootControl);
 
-  initWifiApAndServer();
-  
   // Start Sensor Task on Core 0 (App runs on Core 1 usually)
   xTaskCreatePinnedToCore(
     TaskSensor,   
@@ -1749,60 +4207,23 @@ void setup() {
 
 void loop() {
   // MAIN LOOP (Core 1)
-  // Handles Web & Servo Animation ONLY. 
-  // Should run fast and smooth.
-
-  g_server.handleClient();
-
-  // Sync shared variables to local telemetry
-  if (g_manualMode) {
-    // In manual mode, override sensor data
-    g_t.sensorOk = true;
-    g_t.spo2 = g_manualSpo2;
-    // We can keep the last known HR or just ignore it.
-    // Let's compute target BPM from manual value
-    int target = computeTargetBpm(g_manualSpo2);
-    if (g_t.targetBpm != target) {
-      g_t.targetBpm = target;
-      recomputeCycle(g_t.targetBpm);
-    }
-  } else {
-    // Normal sensor mode
-    g_t.sensorOk = g_sharedSensorOk;
-    g_t.spo2 = g_sharedSpo2;
-    g_t.heartRate = g_sharedHr;
-    
-    // If BPM changed, update cycle duration
-    if (g_t.targetBpm != g_sharedTargetBpm) {
-       g_t.targetBpm = g_sharedTargetBpm;
-       recomputeCycle(g_t.targetBpm);
-    }
-  }
-
-  // Always sync DS18B20 data
-  g_t.tempC = g_sharedTempC;
-  g_t.beatDetected = g_sharedBeatDetected;
-  g_t.lastBeatMs = g_sharedLastBeatMs;
-  
-  // Copy PPG waveform data if available
-  if (g_ppgDataReady) {
-    noInterrupts();
-    for (size_t i = 0; i < kPpgBufferSize; i++) {
-      g_t.ppgData[i] = g_ppgBuffer[i];
+  // Serves HTTP only; breathing and alarms run in TaskControl.
+  static bool networkStarted = false;
+  if (!networkStarted) {
+    networkStarted = true;
+    initWifiApAndServer();
+    Serial.print("Boot phases (us):");
+    for (size_t i = 0; i < kBootPhaseCount; i++) {
+      if (g_bootPhaseUs[i] == 0) continue;
+      Serial.printf(" %s=%lu", kBootPhaseNames[i], static_cast<unsigned long>(g_bootPhaseUs[i]));
     }
-    g_t.ppgDataCount = kPpgBufferSize;
-    interrupts();
-  }
-  
-  // Reset beat flag after reading
-  if (g_sharedBeatDetected) {
-    g_sharedBeatDetected = false;
+    Serial.println();
   }
 
-  updateBreathing();
-  checkAlarms();
-  logPatientData();
-  
-  // Minimal delay to yield Core 1
+  g_server.handleClient();
+  flushAlarmJournal();
+  pushTelemetry();
+  broadcastTelemetry();
+  flushSettings();
   delay(2);
-}
\ No newline at end of file
+}
@@ -0,0 +1,199 @@
+// Host tests for the alarm rule evaluator (pio test -e native).
+// Checks hysteresis, delays and latching on single rules, then times one
+// pass over a 32-row table next to the firmware's 9 rows.
+
+#include <alarm_rules.h>
+#include <unity.h>
+
+#include <chrono>
+#include <stdio.h>
+
+using namespace ventilation;
+
+namespace {
+enum class Sig : uint8_t { Spo2, HeartRate, TempF, SensorOk, Spo2Age, TempAge, Stall, Sqi, Count };
+using Rule = AlarmRule<Sig>;
+
+constexpr Rule kSpo2Low[] = {
+  {"spo2_low", Sig::Spo2, AlarmCmp::Below, 80.0f, 2.0f, 2000, 3000, AlarmPriority::High, true},
+};
+constexpr Rule kHrHigh[] = {
+  {"hr_high", Sig::HeartRate, AlarmCmp::Above, 150.0f, 5.0f, 5000, 5000, AlarmPriority::Medium, false},
+};
+
+// Same shape as kAlarmRules in main.cpp
+constexpr Rule kFirmwareRules[] = {
+  {"spo2_low",    Sig::Spo2,      AlarmCmp::Below, 80.0f,    2.0f,  2000, 3000, AlarmPriority::High,   true},
+  {"temp_low",    Sig::TempF,     AlarmCmp::Below, 80.0f,    1.0f,  2000, 5000, AlarmPriority::Medium, false},
+  {"hr_low",      Sig::HeartRate, AlarmCmp::Below, 40.0f,    5.0f,  5000, 5000, AlarmPriority::Medium, false},
+  {"hr_high",     Sig::HeartRate, AlarmCmp::Above, 150.0f,   5.0f,  5000, 5000, AlarmPriority::Medium, false},
+  {"sensor_lost", Sig::SensorOk,  AlarmCmp::Below, 0.5f,     0.0f,  5000, 2000, AlarmPriority::Medium, false},
+  {"spo2_stale",  Sig::Spo2Age,   AlarmCmp::Above, 10000.0f, 0.0f,  0,    0,    AlarmPriority::Low,    false},
+  {"servo_stall", Sig::Stall,     AlarmCmp::Above, 0.5f,     0.0f,  0,    0,    AlarmPriority::High,   true},
+  {"signal_poor", Sig::Sqi,       AlarmCmp::Below, 50.0f,    10.0f, 5000, 3000, AlarmPriority::Medium, false},
+  {"temp_stale",  Sig::TempAge,   AlarmCmp::Above, 10000.0f, 0.0f,  0,    0,    AlarmPriority::Low,    false},
+};
+
+// The firmware rows plus 23 more over the same signals, with mixed
+// comparators, delays and latching
+constexpr Rule kRules32[] = {
+  {"spo2_low",    Sig::Spo2,      AlarmCmp::Below, 80.0f,    2.0f,  2000, 3000, AlarmPriority::High,   true},
+  {"temp_low",    Sig::TempF,     AlarmCmp::Below, 80.0f,    1.0f,  2000, 5000, AlarmPriority::Medium, false},
+  {"hr_low",      Sig::HeartRate, AlarmCmp::Below, 40.0f,    5.0f,  5000, 5000, AlarmPriority::Medium, false},
+  {"hr_high",     Sig::HeartRate, AlarmCmp::Above, 150.0f,   5.0f,  5000, 5000, AlarmPriority::Medium, false},
+  {"sensor_lost", Sig::SensorOk,  AlarmCmp::Below, 0.5f,     0.0f,  5000, 2000, AlarmPriority::Medium, false},
+  {"spo2_stale",  Sig::Spo2Age,   AlarmCmp::Above, 10000.0f, 0.0f,  0,    0,    AlarmPriority::Low,    false},
+  {"servo_stall", Sig::Stall,     AlarmCmp::Above, 0.5f,     0.0f,  0,    0,    AlarmPriority::High,   true},
+  {"signal_poor", Sig::Sqi,       AlarmCmp::Below, 50.0f,    10.0f, 5000, 3000, AlarmPriority::Medium, false},
+  {"temp_stale",  Sig::TempAge,   AlarmCmp::Above, 10000.0f, 0.0f,  0,    0,    AlarmPriority::Low,    false},
+  {"spo2_85",     Sig::Spo2,      AlarmCmp::Below, 85.0f,    2.0f,  5000, 3000, AlarmPriority::Medium, false},
+  {"spo2_88",     Sig::Spo2,      AlarmCmp::Below, 88.0f,    2.0f,  10000, 3000, AlarmPriority::Low,   false},
+  {"spo2_high",   Sig::Spo2,      AlarmCmp::Above, 99.0f,    1.0f,  30000, 5000, AlarmPriority::Low,   false},
+  {"hr_30",       Sig::HeartRate, AlarmCmp::Below, 30.0f,    5.0f,  1000, 5000, AlarmPriority::High,   true},
+  {"hr_50",       Sig::HeartRate, AlarmCmp::Below, 50.0f,    5.0f,  10000, 5000, AlarmPriority::Low,   false},
+  {"hr_120",      Sig::HeartRate, AlarmCmp::Above, 120.0f,   5.0f,  10000, 5000, AlarmPriority::Low,   false},
+  {"hr_180",      Sig::HeartRate, AlarmCmp::Above, 180.0f,   5.0f,  1000, 5000, AlarmPriority::High,   true},
+  {"temp_75",     Sig::TempF,     AlarmCmp::Below, 75.0f,    1.0f,  2000, 5000, AlarmPriority::High,   true},
+  {"temp_high",   Sig::TempF,     AlarmCmp::Above, 100.0f,   1.0f,  2000, 5000, AlarmPriority::Medium, false},
+  {"temp_104",    Sig::TempF,     AlarmCmp::Above, 104.0f,   1.0f,  1000, 5000, AlarmPriority::High,   true},
+  {"spo2_age_3s", Sig::Spo2Age,   AlarmCmp::Above, 3000.0f,  0.0f,  0,    0,    AlarmPriority::Low,    false},
+  {"spo2_age_30", Sig::Spo2Age,   AlarmCmp::Above, 30000.0f, 0.0f,  0,    0,    AlarmPriority::Medium, false},
+  {"temp_age_30", Sig::TempAge,   AlarmCmp::Above, 30000.0f, 0.0f,  0,    0,    AlarmPriority::Medium, false},
+  {"temp_age_60", Sig::TempAge,   AlarmCmp::Above, 60000.0f, 0.0f,  0,    0,    AlarmPriority::High,   false},
+  {"sensor_30s",  Sig::SensorOk,  AlarmCmp::Below, 0.5f,     0.0f,  30000, 2000, AlarmPriority::High,  true},
+  {"stall_2s",    Sig::Stall,     AlarmCmp::Above, 0.5f,     0.0f,  2000, 0,    AlarmPriority::High,   false},
+  {"sqi_30",      Sig::Sqi,       AlarmCmp::Below, 30.0f,    10.0f, 2000, 3000, AlarmPriority::Medium, false},
+  {"sqi_10",      Sig::Sqi,       AlarmCmp::Below, 10.0f,    5.0f,  10000, 3000, AlarmPriority::High,  true},
+  {"sqi_70",      Sig::Sqi,       AlarmCmp::Below, 70.0f,    10.0f, 30000, 3000, AlarmPriority::Low,   false},
+  {"spo2_92",     Sig::Spo2,      AlarmCmp::Below, 92.0f,    1.0f,  60000, 3000, AlarmPriority::Low,   false},
+  {"hr_100",      Sig::HeartRate, AlarmCmp::Above, 100.0f,   5.0f,  60000, 5000, AlarmPriority::Low,   false},
+  {"temp_90",     Sig::TempF,     AlarmCmp::Below, 90.0f,    1.0f,  60000, 5000, AlarmPriority::Low,   false},
+  {"temp_98",     Sig::TempF,     AlarmCmp::Above, 98.0f,    1.0f,  60000, 5000, AlarmPriority::Low,   false},
+};
+static_assert(sizeof(kRules32) / sizeof(kRules32[0]) == 32, "benchmark table has 32 rows");
+
+constexpr size_t kSignalCount = static_cast<size_t>(Sig::Count);
+
+struct Edges {
+  uint32_t raised = 0;
+  uint32_t cleared = 0;
+  void operator()(size_t, bool up, float) { (up ? raised : cleared)++; }
+};
+
+template <const auto& Rules>
+AlarmSummary step(AlarmState* states, float spo2, float hr, uint64_t nowUs, Edges& edges) {
+  float signals[kSignalCount] = {spo2, hr, 97.0f, 1.0f, 100.0f, 100.0f, 0.0f, 90.0f};
+  AlarmSummary sum;
+  evaluateRules<Rules>(states, signals, nowUs, sum, edges);
+  return sum;
+}
+
+// Mean ns per pass over a trace that crosses thresholds, so the raise and
+// clear paths run as well as the idle one. Best of several runs.
+template <const auto& Rules, size_t N>
+double nsPerPass(AlarmState (&states)[N], Edges& edges) {
+  constexpr uint32_t kPasses = 200000;
+  double best = 1e12;
+  for (int run = 0; run < 5; run++) {
+    for (AlarmState& s : states) s = AlarmState();
+    float signals[kSignalCount];
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kPasses; i++) {
+      const uint64_t nowUs = static_cast<uint64_t>(i) * 10000; // 10 ms control tick
+      const uint32_t phase = (i / 1000) % 4;                   // 10 s per phase
+      signals[0] = phase == 1 ? 70.0f : 96.0f;
+      signals[1] = phase == 2 ? 190.0f : (phase == 3 ? 25.0f : 75.0f);
+      signals[2] = phase == 3 ? 72.0f : 97.0f;
+      signals[3] = phase == 2 ? 0.0f : 1.0f;
+      signals[4] = static_cast<float>((i % 4000) * 10);
+      signals[5] = static_cast<float>((i % 8000) * 10);
+      signals[6] = phase == 1 ? 1.0f : 0.0f;
+      signals[7] = phase == 3 ? 5.0f : 90.0f;
+      AlarmSummary sum;
+      evaluateRules<Rules>(states, signals, nowUs, sum, edges);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / kPasses;
+    if (ns < best) best = ns;
+  }
+  return best;
+}
+
+AlarmState g_states1[1];
+AlarmState g_states9[sizeof(kFirmwareRules) / sizeof(kFirmwareRules[0])];
+AlarmState g_states32[32];
+} // namespace
+
+// Raises only after delayOn, and clears only past threshold + hysteresis
+void test_delay_and_hysteresis() {
+  g_states1[0] = AlarmState();
+  Edges e;
+  step<kHrHigh>(g_states1, 96.0f, 160.0f, 0, e);
+  TEST_ASSERT_TRUE(!g_states1[0].active);
+  step<kHrHigh>(g_states1, 96.0f, 160.0f, 4999000, e);
+  TEST_ASSERT_TRUE(!g_states1[0].active);
+  AlarmSummary sum = step<kHrHigh>(g_states1, 96.0f, 160.0f, 5000000, e);
+  TEST_ASSERT_TRUE(g_states1[0].active);
+  TEST_ASSERT_TRUE(sum.priority == AlarmPriority::Medium);
+  TEST_ASSERT_EQUAL_UINT32(1, e.raised);
+
+  // 148 is below 150 but inside the 5 BPM hysteresis: still a condition
+  step<kHrHigh>(g_states1, 96.0f, 148.0f, 6000000, e);
+  TEST_ASSERT_TRUE(g_states1[0].condition);
+  step<kHrHigh>(g_states1, 96.0f, 140.0f, 7000000, e);
+  TEST_ASSERT_TRUE(!g_states1[0].condition);
+  TEST_ASSERT_TRUE(g_states1[0].active);
+  step<kHrHigh>(g_states1, 96.0f, 140.0f, 12000000, e);
+  TEST_ASSERT_TRUE(!g_states1[0].active);
+  TEST_ASSERT_EQUAL_UINT32(1, e.cleared);
+}
+
+// A latching rule stays active after recovery until it is acknowledged
+void test_latching_holds_until_ack() {
+  g_states1[0] = AlarmState();
+  Edges e;
+  step<kSpo2Low>(g_states1, 70.0f, 75.0f, 0, e);
+  step<kSpo2Low>(g_states1, 70.0f, 75.0f, 2000000, e);
+  TEST_ASSERT_TRUE(g_states1[0].active);
+  step<kSpo2Low>(g_states1, 96.0f, 75.0f, 3000000, e);
+  AlarmSummary sum = step<kSpo2Low>(g_states1, 96.0f, 75.0f, 10000000, e);
+  TEST_ASSERT_TRUE(g_states1[0].active);
+  TEST_ASSERT_TRUE(sum.active && !sum.acked);
+  g_states1[0].acked = true;
+  sum = step<kSpo2Low>(g_states1, 96.0f, 75.0f, 10010000, e);
+  TEST_ASSERT_TRUE(!g_states1[0].active);
+  TEST_ASSERT_TRUE(!sum.active);
+  TEST_ASSERT_EQUAL_UINT32(1, e.cleared);
+}
+
+// No data (NAN) never raises either comparator
+void test_nan_reads_as_absent() {
+  g_states1[0] = AlarmState();
+  Edges e;
+  step<kSpo2Low>(g_states1, NAN, NAN, 0, e);
+  step<kSpo2Low>(g_states1, NAN, NAN, 60000000, e);
+  step<kHrHigh>(g_states1, NAN, NAN, 120000000, e);
+  TEST_ASSERT_TRUE(!g_states1[0].condition);
+  TEST_ASSERT_EQUAL_UINT32(0, e.raised);
+}
+
+// Measured cost of one pass over 32 rules, next to the firmware's 9. The
+// bound only catches gross regressions; the figures are printed.
+void test_32_rule_pass_cost() {
+  Edges edges9, edges32;
+  const double ns9 = nsPerPass<kFirmwareRules>(g_states9, edges9);
+  const double ns32 = nsPerPass<kRules32>(g_states32, edges32);
+  TEST_ASSERT_GREATER_THAN_INT(0, static_cast<int>(edges32.raised));
+  TEST_ASSERT_GREATER_THAN_INT(0, static_cast<int>(edges32.cleared));
+  printf("  alarm pass: 9 rules %.1f ns, 32 rules %.1f ns (%.2f ns/rule)\n", ns9, ns32, ns32 / 32.0);
+  TEST_ASSERT_TRUE(ns32 < 10000.0);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_delay_and_hysteresis);
+  RUN_TEST(test_latching_holds_until_ack);
+  RUN_TEST(test_nan_reads_as_absent);
+  RUN_TEST(test_32_rule_pass_cost);
+  return UNITY_END();
+}
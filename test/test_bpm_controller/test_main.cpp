@@ -0,0 +1,156 @@
+// Host tests for the SpO2 -> BPM controller (pio test -e native).
+// Replays noisy SpO2 traces at the oximeter's 100 ms report rate through
+// the controller with the same curve and constants as main.cpp.
+
+#include <bpm_controller.h>
+#include <unity.h>
+
+#include <random>
+
+using namespace ventilation;
+
+namespace {
+constexpr Spo2BpmPoint kCurve[] = {{90.0f, 20.0f}, {92.5f, 17.0f}, {95.0f, 15.0f}};
+constexpr BpmControlParams kParams = {kCurve, 3, 3000.0f, 10.0f, 0.25f, 1000};
+constexpr uint32_t kSampleMs = 100;
+constexpr uint32_t kTraceMs = 10 * 60 * 1000;
+constexpr float kNoiseSd = 1.0f; // % SpO2, typical reading noise at rest
+
+struct Replay {
+  int finalOutput = 0;
+  uint32_t changes = 0;      // Output changes
+  uint32_t reversals = 0;    // Changes against the direction of the previous one (flaps)
+  uint32_t bigSteps = 0;     // Output changes by more than 1 BPM
+  uint32_t slewViolations = 0;
+};
+
+// baseSpo2 plus seeded Gaussian noise, starting from startBpm
+Replay replay(float baseSpo2, int startBpm, uint32_t seed) {
+  Replay r;
+  BpmController c;
+  seedBpmController(c, startBpm);
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, kNoiseSd);
+
+  int last = c.output;
+  int lastDir = 0;
+  float lastBpm = c.bpm;
+  for (uint32_t t = kSampleMs; t <= kTraceMs; t += kSampleMs) {
+    const int out = updateBpmController(c, kParams, baseSpo2 + noise(rng), t);
+    if (fabsf(c.bpm - lastBpm) > kParams.maxSlewPerMin * kSampleMs / 60000.0f + 1e-4f) r.slewViolations++;
+    lastBpm = c.bpm;
+    if (out != last) {
+      const int dir = out > last ? 1 : -1;
+      if (lastDir != 0 && dir != lastDir) r.reversals++;
+      if (out - last > 1 || last - out > 1) r.bigSteps++;
+      lastDir = dir;
+      last = out;
+      r.changes++;
+    }
+  }
+  r.finalOutput = last;
+  return r;
+}
+
+// The old three-step table on the raw reading, for comparison
+uint32_t tableChanges(float baseSpo2, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, kNoiseSd);
+  int last = -1;
+  uint32_t changes = 0;
+  for (uint32_t t = kSampleMs; t <= kTraceMs; t += kSampleMs) {
+    const float s = baseSpo2 + noise(rng);
+    const int bpm = s < 90.0f ? 20 : (s < 95.0f ? 17 : 15);
+    if (last >= 0 && bpm != last) changes++;
+    last = bpm;
+  }
+  return changes;
+}
+
+void checkTrace(float baseSpo2, int expectedBpm, uint32_t maxChanges) {
+  for (uint32_t seed = 1; seed <= 5; seed++) {
+    const Replay r = replay(baseSpo2, 15, seed);
+    TEST_ASSERT_EQUAL_INT(expectedBpm, r.finalOutput);
+    TEST_ASSERT_EQUAL_UINT32(0, r.reversals);
+    TEST_ASSERT_EQUAL_UINT32(0, r.bigSteps);
+    TEST_ASSERT_EQUAL_UINT32(0, r.slewViolations);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(static_cast<int>(maxChanges), static_cast<int>(r.changes));
+  }
+}
+} // namespace
+
+void test_map_follows_curve() {
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, mapSpo2ToBpm(kParams, 80.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, mapSpo2ToBpm(kParams, 90.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 18.5f, mapSpo2ToBpm(kParams, 91.25f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 17.0f, mapSpo2ToBpm(kParams, 92.5f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 15.0f, mapSpo2ToBpm(kParams, 95.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 15.0f, mapSpo2ToBpm(kParams, 100.0f));
+}
+
+// Each trace settles on the curve value, moving 1 BPM at a time in one
+// direction only: no flapping, however noisy the reading
+void test_trace_90() { checkTrace(90.0f, 20, 5); }
+void test_trace_92_5() { checkTrace(92.5f, 17, 2); }
+void test_trace_95() { checkTrace(95.0f, 15, 0); }
+void test_trace_86() { checkTrace(86.0f, 20, 5); }
+
+// At 10 BPM/min the output reaches 20 only once the rate passes 19.25
+// (rounding plus hysteresis), i.e. no sooner than 25.5 s after starting at 15
+void test_ramp_respects_slew() {
+  BpmController c;
+  seedBpmController(c, 15);
+  uint32_t reachedMs = 0;
+  for (uint32_t t = kSampleMs; t <= 120000 && reachedMs == 0; t += kSampleMs) {
+    if (updateBpmController(c, kParams, 86.0f, t) == 20) reachedMs = t;
+  }
+  TEST_ASSERT_GREATER_THAN_INT(0, static_cast<int>(reachedMs));
+  TEST_ASSERT_TRUE(reachedMs >= 25500);
+}
+
+// A sample gap counts as at most maxDtMs, so a late sample cannot jump the rate
+void test_sample_gap_is_capped() {
+  BpmController c;
+  seedBpmController(c, 15);
+  updateBpmController(c, kParams, 86.0f, 0);
+  updateBpmController(c, kParams, 86.0f, 60000);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(15.0f + kParams.maxSlewPerMin * kParams.maxDtMs / 60000.0f + 1e-4f, c.bpm);
+  TEST_ASSERT_EQUAL_INT(15, c.output);
+}
+
+// An operator-set rate (seed) is where the controller continues from: the
+// next samples slew away from it instead of stepping back to the curve
+void test_seed_holds_operator_rate() {
+  BpmController c;
+  seedBpmController(c, 15);
+  for (uint32_t t = kSampleMs; t <= 60000; t += kSampleMs) updateBpmController(c, kParams, 98.0f, t);
+  seedBpmController(c, 25);
+  int last = c.output;
+  for (uint32_t t = 60000 + kSampleMs; t <= 90000; t += kSampleMs) {
+    const int out = updateBpmController(c, kParams, 98.0f, t);
+    TEST_ASSERT_TRUE(out == last || out == last - 1);
+    last = out;
+  }
+  // 30 s at 10 BPM/min: about halfway back to 15
+  TEST_ASSERT_TRUE(last >= 20 && last <= 21);
+}
+
+// The replay must be able to fail: the old table on the same traces flaps
+void test_table_flaps_on_same_traces() {
+  TEST_ASSERT_GREATER_THAN_INT(100, static_cast<int>(tableChanges(95.0f, 1)));
+  TEST_ASSERT_GREATER_THAN_INT(100, static_cast<int>(tableChanges(90.0f, 1)));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_map_follows_curve);
+  RUN_TEST(test_trace_90);
+  RUN_TEST(test_trace_92_5);
+  RUN_TEST(test_trace_95);
+  RUN_TEST(test_trace_86);
+  RUN_TEST(test_ramp_respects_slew);
+  RUN_TEST(test_sample_gap_is_capped);
+  RUN_TEST(test_seed_holds_operator_rate);
+  RUN_TEST(test_table_flaps_on_same_traces);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+// Host tests for the breath cycle staging and trajectory (pio test -e native).
+// The tick loop mirrors updateBreathing(): 5 ms period, rate changes staged
+// by recomputeCycle() and applied at the exhale-complete boundary.
+
+#include <breath_cycle.h>
+#include <unity.h>
+
+using namespace ventilation;
+
+namespace {
+constexpr uint32_t kTickMs = 5;
+constexpr float kInhaleFraction = 0.4f;
+constexpr float kMinAngle = 0.0f;
+constexpr float kPeakAngle = 90.0f;
+constexpr float kSlewLimitDegPerSec = 300.0f;
+constexpr float kPulseStepDeg = 180.0f / (2400 - 500);
+
+struct Run {
+  uint32_t rateChangeMs;  // When the new rate is requested
+  uint32_t appliedMs = 0; // When the new cycle length took effect
+  uint32_t boundaryMs = 0; // First cycle boundary after the request
+  float maxStepDeg = 0.0f;
+  uint32_t violations = 0;
+};
+
+// Simulates totalMs of ventilation starting at fromBpm and requesting toBpm
+// at rateChangeMs. stageChanges = false applies the rate immediately, as the
+// code did before staging.
+Run simulate(int fromBpm, int toBpm, uint32_t rateChangeMs, uint32_t totalMs, bool stageChanges = true) {
+  Run r;
+  r.rateChangeMs = rateChangeMs;
+  CycleTiming cycle = {60000U / static_cast<uint32_t>(fromBpm)};
+  uint32_t cycleStartMs = 0;
+  float lastAngle = kMinAngle;
+
+  for (uint32_t now = kTickMs; now <= totalMs; now += kTickMs) {
+    if (now == rateChangeMs) {
+      stageRate(cycle, toBpm);
+      if (!stageChanges) applyPendingRate(cycle);
+    }
+    uint32_t elapsed = now - cycleStartMs;
+    if (elapsed >= cycle.durationMs) {
+      if (now > rateChangeMs && r.boundaryMs == 0) r.boundaryMs = now;
+      applyPendingRate(cycle);
+      cycleStartMs = now;
+      elapsed = 0;
+    }
+    if (r.appliedMs == 0 && cycle.durationMs == 60000U / static_cast<uint32_t>(toBpm)) {
+      r.appliedMs = now;
+    }
+
+    const float angle = trajectoryAngle(elapsed, cycle.durationMs, kInhaleFraction, kMinAngle, kPeakAngle);
+    const float step = fabsf(angle - lastAngle);
+    if (step > r.maxStepDeg) r.maxStepDeg = step;
+    if (!withinSlewLimit(step, kTickMs / 1000.0f, kSlewLimitDegPerSec, kPulseStepDeg)) r.violations++;
+    lastAngle = angle;
+  }
+  return r;
+}
+} // namespace
+
+void test_stage_rate_waits_for_apply() {
+  CycleTiming c = {4000};
+  stageRate(c, 20);
+  TEST_ASSERT_EQUAL_UINT32(4000, c.durationMs);
+  TEST_ASSERT_EQUAL_UINT32(3000, c.pendingMs);
+  applyPendingRate(c);
+  TEST_ASSERT_EQUAL_UINT32(3000, c.durationMs);
+  TEST_ASSERT_EQUAL_UINT32(0, c.pendingMs);
+  applyPendingRate(c); // Nothing pending: no change
+  TEST_ASSERT_EQUAL_UINT32(3000, c.durationMs);
+}
+
+void test_stage_rate_ignores_invalid_bpm() {
+  CycleTiming c = {4000};
+  stageRate(c, 0);
+  stageRate(c, -5);
+  TEST_ASSERT_EQUAL_UINT32(0, c.pendingMs);
+}
+
+void test_trajectory_endpoints() {
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, kMinAngle, trajectoryAngle(0, 4000, kInhaleFraction, kMinAngle, kPeakAngle));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, kPeakAngle, trajectoryAngle(1600, 4000, kInhaleFraction, kMinAngle, kPeakAngle));
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, kMinAngle, trajectoryAngle(3999, 4000, kInhaleFraction, kMinAngle, kPeakAngle));
+}
+
+// Mid-inhale request from 15 to 40 BPM: the cycle length changes exactly at
+// the next boundary and no tick exceeds the slew limit
+void test_mid_breath_change_applies_at_boundary() {
+  const Run r = simulate(15, 40, 1000, 20000);
+  TEST_ASSERT_EQUAL_UINT32(4000, r.boundaryMs);
+  TEST_ASSERT_EQUAL_UINT32(r.boundaryMs, r.appliedMs);
+  TEST_ASSERT_EQUAL_UINT32(0, r.violations);
+}
+
+// Same for a request at any point of the breath, in both directions
+void test_change_anywhere_in_breath_within_slew_limit() {
+  for (uint32_t at = kTickMs; at < 4000; at += 35) {
+    const Run r = simulate(15, 40, at, 12000);
+    TEST_ASSERT_EQUAL_UINT32(r.boundaryMs, r.appliedMs);
+    TEST_ASSERT_EQUAL_UINT32(0, r.violations);
+  }
+  for (uint32_t at = kTickMs; at < 1500; at += 35) {
+    const Run r = simulate(40, 15, at, 12000);
+    TEST_ASSERT_EQUAL_UINT32(r.boundaryMs, r.appliedMs);
+    TEST_ASSERT_EQUAL_UINT32(0, r.violations);
+  }
+}
+
+// The check must be able to fail: applying the rate immediately mid-inhale
+// rescales elapsed/duration and jumps the servo
+void test_unstaged_change_is_detected() {
+  const Run r = simulate(15, 40, 1000, 8000, false);
+  TEST_ASSERT_TRUE(r.violations > 0);
+  TEST_ASSERT_TRUE(r.maxStepDeg > kSlewLimitDegPerSec * kTickMs / 1000.0f);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stage_rate_waits_for_apply);
+  RUN_TEST(test_stage_rate_ignores_invalid_bpm);
+  RUN_TEST(test_trajectory_endpoints);
+  RUN_TEST(test_mid_breath_change_applies_at_boundary);
+  RUN_TEST(test_change_anywhere_in_breath_within_slew_limit);
+  RUN_TEST(test_unstaged_change_is_detected);
+  return UNITY_END();
+}
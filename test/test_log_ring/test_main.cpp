@@ -0,0 +1,137 @@
+// Host tests for the data log lookups (pio test -e native).
+// Rows sit in a 40-slot ring that has wrapped (the oldest row is not in
+// slot 0), read through ringSlot() the way handleGetData() reads g_dataLog.
+
+#include <log_ring.h>
+#include <unity.h>
+
+#include <vector>
+
+using namespace ventilation;
+
+namespace {
+constexpr size_t kCapacity = 40;
+
+struct Row {
+  uint64_t timestampUs;
+  float spo2;
+  float hr;
+};
+
+struct Ring {
+  Row rows[kCapacity];
+  size_t head = 0;
+  size_t count = 0;
+
+  void append(const Row& r) {
+    rows[head] = r;
+    head = (head + 1) % kCapacity;
+    if (count < kCapacity) count++;
+  }
+
+  const Row& at(size_t i) const { return rows[ringSlot(head, count, kCapacity, i)]; }
+};
+
+// 93 rows, a minute apart with jitter and an occasional long gap; the last
+// 40 remain. SpO2 wanders around 95 % with one dip at row 70.
+Ring makeRing() {
+  Ring ring;
+  uint32_t seed = 7;
+  uint64_t t = 60000000ULL;
+  for (size_t k = 0; k < 93; k++) {
+    seed = seed * 1103515245u + 12345u;
+    const float noise = static_cast<float>((seed >> 8) & 0xFF) / 256.0f;
+    t += (k % 11 == 4 ? 300000000ULL : 60000000ULL) + (seed & 0xFFFF);
+    ring.append({t, k == 70 ? 81.0f : 94.0f + 2.0f * noise, k % 9 == 2 ? NAN : 70.0f + 10.0f * noise});
+  }
+  return ring;
+}
+
+LttbPoint<2> point(const Ring& ring, size_t i) {
+  const Row& r = ring.at(i);
+  return {static_cast<float>(r.timestampUs - ring.at(0).timestampUs) / 1e6f, {r.spo2 / 100.0f, r.hr / 200.0f}};
+}
+
+std::vector<size_t> downsample(const Ring& ring, size_t first, size_t last, size_t n) {
+  std::vector<size_t> out;
+  lttbDownsample<2>(first, last, n, [&](size_t i) { return point(ring, i); },
+                    [&](size_t i) { out.push_back(i); });
+  return out;
+}
+} // namespace
+
+void test_ring_wrapped() {
+  const Ring ring = makeRing();
+  TEST_ASSERT_EQUAL_UINT32(kCapacity, ring.count);
+  TEST_ASSERT_TRUE(ring.head != 0);
+  for (size_t i = 1; i < ring.count; i++) {
+    TEST_ASSERT_TRUE(ring.at(i - 1).timestampUs < ring.at(i).timestampUs);
+  }
+}
+
+void test_lower_bound_matches_linear_scan() {
+  const Ring ring = makeRing();
+  auto ts = [&](size_t i) { return ring.at(i).timestampUs; };
+  std::vector<uint64_t> targets = {0, ts(0) - 1, ts(ring.count - 1) + 1, UINT64_MAX};
+  for (size_t i = 0; i < ring.count; i++) {
+    targets.push_back(ts(i) - 1);
+    targets.push_back(ts(i));
+    targets.push_back(ts(i) + 1);
+  }
+  for (uint64_t target : targets) {
+    size_t expected = 0;
+    while (expected < ring.count && ts(expected) < target) expected++;
+    TEST_ASSERT_EQUAL_UINT32(expected, ringLowerBound(ring.count, target, ts));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, ringLowerBound(0, 5, ts));
+}
+
+void test_lttb_keeps_ends_and_one_row_per_bucket() {
+  const Ring ring = makeRing();
+  for (size_t first : {size_t(0), size_t(7)}) {
+    for (size_t n = 3; n < ring.count - first; n++) {
+      const std::vector<size_t> out = downsample(ring, first, ring.count, n);
+      TEST_ASSERT_EQUAL_UINT32(n, out.size());
+      TEST_ASSERT_EQUAL_UINT32(first, out.front());
+      TEST_ASSERT_EQUAL_UINT32(ring.count - 1, out.back());
+      // Bucket b covers [first + 1 + floor(b * size), first + 1 + floor((b + 1) * size))
+      const float size = static_cast<float>(ring.count - first - 2) / (n - 2);
+      for (size_t b = 0; b < n - 2; b++) {
+        const size_t begin = first + 1 + static_cast<size_t>(b * size);
+        const size_t end = b + 1 < n - 2 ? first + 1 + static_cast<size_t>((b + 1) * size) : ring.count - 1;
+        TEST_ASSERT_TRUE(out[b + 1] >= begin && out[b + 1] < end);
+      }
+    }
+  }
+}
+
+void test_lttb_keeps_dip() {
+  const Ring ring = makeRing();
+  // Row 70 of 93 is logical index 70 - (93 - 40) = 17
+  TEST_ASSERT_TRUE(ring.at(17).spo2 < 90.0f);
+  for (size_t n = 4; n <= 20; n++) {
+    bool kept = false;
+    for (size_t i : downsample(ring, 0, ring.count, n)) kept |= ring.at(i).spo2 < 90.0f;
+    TEST_ASSERT_TRUE(kept);
+  }
+}
+
+void test_lttb_passes_short_ranges_through() {
+  const Ring ring = makeRing();
+  const std::vector<size_t> out = downsample(ring, 30, ring.count, 10);
+  TEST_ASSERT_EQUAL_UINT32(10, out.size());
+  for (size_t k = 0; k < out.size(); k++) {
+    TEST_ASSERT_EQUAL_UINT32(30 + k, out[k]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, downsample(ring, ring.count, ring.count, 5).size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_wrapped);
+  RUN_TEST(test_lower_bound_matches_linear_scan);
+  RUN_TEST(test_lttb_keeps_ends_and_one_row_per_bucket);
+  RUN_TEST(test_lttb_keeps_dip);
+  RUN_TEST(test_lttb_passes_short_ranges_through);
+  return UNITY_END();
+}
@@ -0,0 +1,117 @@
+// Host tests for the PPG signal quality index (pio test -e native).
+// Synthetic raw IR at 50 Hz, 75 BPM, with the same constants as kSqi in
+// main.cpp. Beats are flagged at each pulse foot, as the library's beat
+// detector does on the device. A clean pulse must pass the publish gate
+// (kSqiGoodThreshold, 50) and each kind of bad signal must fail it.
+
+#include <signal_quality.h>
+#include <unity.h>
+
+#include <random>
+#include <vector>
+
+using namespace ventilation;
+
+namespace {
+constexpr uint8_t kGoodThreshold = 50;
+constexpr SqiParams kSqi = {150, 65000, 2000, 0.2f, 0.5f, 20.0f, 0.5f, 0.9f, 0.10f, 0.2f, 4};
+constexpr float kSampleHz = 50.0f;
+constexpr size_t kBeatSamples = 40; // 75 BPM
+constexpr size_t kWindows = 8;      // 24 s
+
+// One pulse, 0 at the foot: systolic peak then a dicrotic wave
+float pulse(float phase) {
+  auto bump = [](float x, float mu, float sd) { return expf(-0.5f * (x - mu) * (x - mu) / (sd * sd)); };
+  return bump(phase, 0.18f, 0.07f) + 0.4f * bump(phase, 0.45f, 0.08f);
+}
+
+struct Trace {
+  float dc = 30000.0f;
+  float acPct = 1.5f;       // Pulse height over DC
+  float wanderPct = 0.0f;   // Baseline swing (motion), % of DC
+  float wanderHz = 0.0f;
+  float noise = 10.0f;      // Raw counts, SD
+  float jerkPct = 0.0f;     // Random spikes (motion), % of DC
+  bool beats = true;
+};
+
+// Scores of every completed window
+std::vector<uint8_t> score(const Trace& tr, uint32_t seed = 1) {
+  SignalQuality<16> q;
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, tr.noise);
+  std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+  std::vector<uint8_t> scores;
+  for (size_t n = 0; n < kWindows * kSqi.windowSamples; n++) {
+    const float t = n / kSampleHz;
+    const size_t pos = n % kBeatSamples;
+    if (tr.beats && pos == 0) q.beatPending = true;
+    float ir = tr.dc * (1.0f + tr.acPct / 100.0f * pulse(pos / static_cast<float>(kBeatSamples)) +
+                        tr.wanderPct / 100.0f * sinf(6.2831853f * tr.wanderHz * t));
+    if (tr.jerkPct > 0.0f && uni(rng) < 0.15f) ir += tr.dc * tr.jerkPct / 100.0f * (uni(rng) - 0.5f);
+    ir = std::max(0.0f, std::min(65535.0f, ir + noise(rng)));
+    const uint16_t raw = static_cast<uint16_t>(ir);
+    if (addSqiSample(q, kSqi, raw, static_cast<uint16_t>(raw * 0.8f))) scores.push_back(q.score);
+  }
+  return scores;
+}
+
+// Worst (for clean) or best (for bad) score once the template has settled
+uint8_t settledMin(const std::vector<uint8_t>& s) {
+  uint8_t m = 100;
+  for (size_t i = 2; i < s.size(); i++) m = std::min(m, s[i]);
+  return m;
+}
+
+uint8_t settledMax(const std::vector<uint8_t>& s) {
+  uint8_t m = 0;
+  for (size_t i = 2; i < s.size(); i++) m = std::max(m, s[i]);
+  return m;
+}
+} // namespace
+
+void test_clean_ppg_scores_high() {
+  const std::vector<uint8_t> s = score(Trace());
+  TEST_ASSERT_EQUAL_UINT32(kWindows, s.size());
+  TEST_ASSERT_GREATER_THAN_INT(80, settledMin(s));
+}
+
+void test_motion_artifact_scores_low() {
+  Trace walking;
+  walking.wanderPct = 8.0f; // Arm swing: baseline moves more than the pulse
+  walking.wanderHz = 0.45f;
+  walking.jerkPct = 3.0f;
+  TEST_ASSERT_TRUE(settledMax(score(walking)) < kGoodThreshold);
+}
+
+void test_flatline_scores_zero() {
+  Trace flat;
+  flat.acPct = 0.0f;
+  flat.beats = false;
+  TEST_ASSERT_EQUAL_UINT32(0, settledMax(score(flat)));
+
+  flat.beats = true; // Spurious beat flags on a flat line do not help
+  TEST_ASSERT_TRUE(settledMax(score(flat)) < kGoodThreshold);
+}
+
+void test_clipped_scores_zero() {
+  Trace clipped;
+  clipped.dc = 64500.0f; // Pulse peaks hit the ADC ceiling
+  TEST_ASSERT_EQUAL_UINT32(0, settledMax(score(clipped)));
+}
+
+void test_no_finger_scores_zero() {
+  Trace ambient;
+  ambient.dc = 800.0f;
+  TEST_ASSERT_EQUAL_UINT32(0, settledMax(score(ambient)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_ppg_scores_high);
+  RUN_TEST(test_motion_artifact_scores_low);
+  RUN_TEST(test_flatline_scores_zero);
+  RUN_TEST(test_clipped_scores_zero);
+  RUN_TEST(test_no_finger_scores_zero);
+  return UNITY_END();
+}
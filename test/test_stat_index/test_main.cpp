@@ -0,0 +1,196 @@
+// Host tests for the /stats block index (pio test -e native).
+// A small ring (50 slots, blocks of 8, so the last block is partial) is kept
+// the way logPatientData() keeps g_dataLog: append, then rebuild the written
+// slot's block. Every logical range is checked against a brute-force scan.
+
+#include <stat_index.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace ventilation;
+
+namespace {
+constexpr size_t kCapacity = 50;
+constexpr size_t kBlockSize = 8;
+constexpr size_t kBlockCount = (kCapacity + kBlockSize - 1) / kBlockSize;
+constexpr size_t kMetrics = 2;
+constexpr size_t kBins = 32;
+constexpr StatBinning kBinning[kMetrics] = {
+  {"spo2", 68.0f, 1.0f},
+  {"hr",   30.0f, 5.0f},
+};
+constexpr float kPercentiles[] = {0.05f, 0.50f, 0.95f};
+
+using Row = StatRow<kMetrics>;
+using Block = StatBlock<kMetrics, kBins>;
+using Result = StatResult<kMetrics, kBins>;
+
+struct Ring {
+  Row rows[kCapacity];
+  Block blocks[kBlockCount];
+  size_t head = 0;
+  size_t count = 0;
+  uint64_t nextUs = 60000000ULL;
+  uint32_t seed = 12345;
+
+  float rand01() {
+    seed = seed * 1103515245u + 12345u;
+    return static_cast<float>((seed >> 8) & 0xFFFF) / 65536.0f;
+  }
+
+  size_t slot(size_t i) const { return (head + kCapacity - count + i) % kCapacity; }
+
+  void rebuild(size_t block) {
+    const size_t first = block * kBlockSize;
+    size_t end = std::min(first + kBlockSize, kCapacity);
+    if (count < kCapacity) end = std::min(end, head);
+    blocks[block] = buildStatBlock<kMetrics, kBins>(kBinning, first, std::max(first, end),
+                                                    [this](size_t s) { return rows[s]; });
+  }
+
+  // SpO2 88-100 %, HR 55-135 BPM; every 7th row has no SpO2
+  void append(size_t n = 1) {
+    for (size_t k = 0; k < n; k++) {
+      Row r;
+      r.timestampUs = nextUs;
+      nextUs += 60000000ULL;
+      r.value[0] = (r.timestampUs / 60000000ULL) % 7 == 3 ? NAN : 88.0f + 12.0f * rand01();
+      r.value[1] = 55.0f + 80.0f * rand01();
+      const size_t s = head;
+      rows[s] = r;
+      head = (head + 1) % kCapacity;
+      if (count < kCapacity) count++;
+      rebuild(s / kBlockSize);
+    }
+  }
+
+  uint64_t oldestUs() const { return rows[slot(0)].timestampUs; }
+  uint64_t newestUs() const { return rows[slot(count - 1)].timestampUs; }
+
+  Result query(size_t first, size_t last, uint64_t oldest, uint64_t newest) const {
+    Result r;
+    statAccumulateRing<kBlockSize, kCapacity>(
+        kBinning, slot(first), last - first, oldest, newest,
+        [this](size_t s) { return rows[s]; }, [this](size_t b) { return blocks[b]; }, r);
+    return r;
+  }
+};
+
+// Smallest value with at least ceil(p * n) values at or below it
+float nearestRank(std::vector<float> v, float p) {
+  std::sort(v.begin(), v.end());
+  size_t rank = static_cast<size_t>(ceilf(p * v.size()));
+  if (rank < 1) rank = 1;
+  return v[rank - 1];
+}
+
+uint32_t g_failures = 0;
+
+// Compares r with a scan of the rows passing keep()
+template <typename Keep>
+void checkAgainstScan(const Ring& ring, size_t first, size_t last, const Result& r, Keep keep) {
+  std::vector<float> values[kMetrics];
+  size_t rows = 0;
+  for (size_t i = first; i < last; i++) {
+    const Row& row = ring.rows[ring.slot(i)];
+    if (!keep(row)) continue;
+    rows++;
+    for (size_t m = 0; m < kMetrics; m++) {
+      if (!isnan(row.value[m])) values[m].push_back(row.value[m]);
+    }
+  }
+  bool ok = r.rows == rows;
+  for (size_t m = 0; m < kMetrics && ok; m++) {
+    const std::vector<float>& v = values[m];
+    const StatAccum& a = r.acc[m];
+    ok = a.count == v.size();
+    if (!ok || v.empty()) continue;
+    double sum = 0.0;
+    for (float x : v) sum += x;
+    ok = a.min == *std::min_element(v.begin(), v.end()) &&
+         a.max == *std::max_element(v.begin(), v.end()) &&
+         fabs(a.sum / a.count - sum / v.size()) < 1e-6;
+    const float err = statPercentileError(a, kBinning[m], kBins);
+    ok = ok && err == kBinning[m].binWidth;
+    for (float p : kPercentiles) {
+      const float est = statPercentile(a, r.hist[m], kBinning[m], p);
+      ok = ok && fabsf(est - nearestRank(v, p)) <= err + 1e-4f;
+    }
+  }
+  if (!ok) g_failures++;
+}
+} // namespace
+
+void test_every_range_matches_brute_force() {
+  for (size_t appended : {size_t(13), size_t(50), size_t(131)}) {
+    Ring ring;
+    ring.append(appended);
+    g_failures = 0;
+    for (size_t first = 0; first < ring.count; first++) {
+      for (size_t last = first + 1; last <= ring.count; last++) {
+        const Result r = ring.query(first, last, ring.oldestUs(), ring.newestUs());
+        checkAgainstScan(ring, first, last, r, [](const Row&) { return true; });
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, g_failures);
+  }
+}
+
+void test_rows_appended_after_snapshot_not_counted() {
+  Ring ring;
+  ring.append(131); // Full and wrapped
+  const uint64_t oldest = ring.oldestUs();
+  const uint64_t newest = ring.newestUs();
+  const Ring before = ring;
+
+  // Appends overwrite the oldest rows, inside whole blocks of the range
+  ring.append(11);
+  g_failures = 0;
+  for (size_t first = 0; first < kCapacity; first += 3) {
+    for (size_t last = first + 1; last <= kCapacity; last += 2) {
+      // The snapshot's logical indices, now resolved against the old head
+      Ring view = ring;
+      view.head = before.head;
+      const Result r = view.query(first, last, oldest, newest);
+      checkAgainstScan(view, first, last, r, [&](const Row& row) {
+        return row.timestampUs >= oldest && row.timestampUs <= newest;
+      });
+      TEST_ASSERT_TRUE(r.rows <= last - first);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, g_failures);
+}
+
+void test_block_rebuilt_late_is_scanned() {
+  Ring ring;
+  ring.append(131);
+  // A row written but its block not yet rebuilt (logPatientData() rebuilds
+  // after releasing the lock): the stale block must not be merged
+  const size_t s = ring.head;
+  const Block stale = ring.blocks[s / kBlockSize];
+  ring.append();
+  ring.blocks[s / kBlockSize] = stale;
+  const Result r = ring.query(0, ring.count, ring.oldestUs(), ring.newestUs());
+  g_failures = 0;
+  checkAgainstScan(ring, 0, ring.count, r, [](const Row&) { return true; });
+  TEST_ASSERT_EQUAL_UINT32(0, g_failures);
+}
+
+void test_error_bound_unknown_outside_bins() {
+  StatAccum a;
+  statAdd(a, 90.0f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, statPercentileError(a, kBinning[0], kBins));
+  statAdd(a, 60.0f); // Below 68 %: clamps into bin 0
+  TEST_ASSERT_TRUE(isnan(statPercentileError(a, kBinning[0], kBins)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_range_matches_brute_force);
+  RUN_TEST(test_rows_appended_after_snapshot_not_counted);
+  RUN_TEST(test_block_rebuilt_late_is_scanned);
+  RUN_TEST(test_error_bound_unknown_outside_bins);
+  return UNITY_END();
+}
@@ -0,0 +1,77 @@
+// Host tests for the tidal volume PID and the flow sensor CRC
+// (pio test -e native). The lung is a static gain, mL per degree of peak
+// angle, with the same PID constants as kVolumePid in main.cpp.
+
+#include <volume_control.h>
+#include <unity.h>
+
+using namespace ventilation;
+
+namespace {
+constexpr int32_t kMaxAngle = 90;
+constexpr VolumePidParams kPid = {400, 20 << 8, kMaxAngle << 8, 5 << 8, 1311, 2949, 0};
+
+int32_t lungMl(int32_t peakQ8, float mlPerDeg) {
+  return static_cast<int32_t>(mlPerDeg * peakQ8 / 256.0f);
+}
+} // namespace
+
+void test_crc_datasheet_example() {
+  const uint8_t beef[] = {0xBE, 0xEF};
+  TEST_ASSERT_EQUAL_UINT32(0x92, sensirionCrc8(beef, 2));
+  const uint8_t zero[] = {0x00, 0x00};
+  TEST_ASSERT_EQUAL_UINT32(0x81, sensirionCrc8(zero, 2));
+  TEST_ASSERT_EQUAL_UINT32(0xFF, sensirionCrc8(beef, 0));
+}
+
+// 6 mL/deg: 400 mL at 66.7 deg, starting from the 90 deg ceiling
+void test_converges_to_target() {
+  VolumeControl v = {kPid.maxPeakQ8};
+  int32_t lastPeak = v.peakQ8;
+  for (int breath = 0; breath < 40; breath++) {
+    updateVolumePid(v, kPid, lungMl(v.peakQ8, 6.0f));
+    const int32_t step = v.peakQ8 - lastPeak;
+    TEST_ASSERT_TRUE(step <= kPid.maxStepQ8 && step >= -kPid.maxStepQ8);
+    lastPeak = v.peakQ8;
+  }
+  TEST_ASSERT_TRUE(v.lastTidalMl >= 390 && v.lastTidalMl <= 410);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, 66.7f, v.peakQ8 / 256.0f);
+}
+
+// 3 mL/deg cannot reach 400 mL below the ceiling. While pinned there, no
+// error builds up: once the lung stiffens the very next breath backs off.
+void test_no_windup_at_ceiling() {
+  VolumeControl v = {60 << 8};
+  for (int breath = 0; breath < 100; breath++) {
+    updateVolumePid(v, kPid, lungMl(v.peakQ8, 3.0f));
+  }
+  TEST_ASSERT_EQUAL_INT(kPid.maxPeakQ8, v.peakQ8);
+
+  // 900 mL: full steps down from the first breath until the error is small
+  for (int breath = 0; breath < 8; breath++) {
+    const int32_t before = v.peakQ8;
+    updateVolumePid(v, kPid, lungMl(v.peakQ8, 10.0f));
+    TEST_ASSERT_EQUAL_INT(before - kPid.maxStepQ8, v.peakQ8);
+  }
+  for (int breath = 0; breath < 8; breath++) {
+    updateVolumePid(v, kPid, lungMl(v.peakQ8, 10.0f));
+  }
+  TEST_ASSERT_TRUE(v.lastTidalMl >= 390 && v.lastTidalMl <= 410);
+}
+
+void test_floor_holds() {
+  VolumeControl v = {30 << 8};
+  for (int breath = 0; breath < 20; breath++) {
+    updateVolumePid(v, kPid, 2000);
+  }
+  TEST_ASSERT_EQUAL_INT(kPid.minPeakQ8, v.peakQ8);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_datasheet_example);
+  RUN_TEST(test_converges_to_target);
+  RUN_TEST(test_no_windup_at_ceiling);
+  RUN_TEST(test_floor_holds);
+  return UNITY_END();
+}
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Central station: collects telemetry frames from many ventilators.
+
+Devices connect over TCP (firmware: kAggregatorHost/kAggregatorPort) and
+stream fixed-size TelemetryFrames. Each bed keeps the last --history frames
+in a preallocated byte ring, so memory is fixed per bed no matter how long
+it runs. A combined dashboard and JSON API are served over HTTP.
+
+    python3 aggregator.py --ingest-port 7700 --http-port 8080
+
+Standard library only (Python 3.8+). One asyncio event loop handles every
+connection, so 100 beds at 1 Hz is a few hundred frames a second.
+"""
+
+import argparse
+import asyncio
+import json
+import time
+from urllib.parse import parse_qs, urlsplit
+
+import telemetry_frame as tf
+
+STALE_S = 5.0  # Bed shown as offline after this long without a frame
+
+
+class Bed:
+    def __init__(self, bed_id, history):
+        self.bed_id = bed_id
+        self.history = history
+        self.ring = bytearray(history * tf.FRAME.size)
+        self.head = 0
+        self.count = 0
+        self.latest = None
+        self.last_rx = 0.0
+        self.peer = None
+        self.frames = 0
+        self.gaps = 0  # Frames missing according to seq
+        self.last_seq = None
+
+    def add(self, raw, frame, peer):
+        off = self.head * tf.FRAME.size
+        self.ring[off:off + tf.FRAME.size] = raw
+        self.head = (self.head + 1) % self.history
+        self.count = min(self.count + 1, self.history)
+
+        # seq restarts from 1 when the device reboots
+        if self.last_seq is not None and frame["seq"] > self.last_seq + 1:
+            self.gaps += frame["seq"] - self.last_seq - 1
+        self.last_seq = frame["seq"]
+        self.latest = frame
+        self.last_rx = time.monotonic()
+        self.peer = peer
+        self.frames += 1
+
+    def recent(self, n):
+        n = min(n, self.count)
+        out = []
+        for i in range(self.count - n, self.count):
+            slot = (self.head - self.count + i) % self.history
+            off = slot * tf.FRAME.size
+            out.append(tf.unpack(bytes(self.ring[off:off + tf.FRAME.size])))
+        return out
+
+    def summary(self):
+        return {
+            "bed": self.bed_id,
+            "online": time.monotonic() - self.last_rx < STALE_S,
+            "age_s": round(time.monotonic() - self.last_rx, 1),
+            "peer": self.peer,
+            "frames": self.frames,
+            "gaps": self.gaps,
+            "latest": self.latest,
+        }
+
+
+class Aggregator:
+    def __init__(self, history):
+        self.history = history
+        self.beds = {}
+        self.connections = 0
+        self.bad_frames = 0
+
+    async def handle_device(self, reader, writer):
+        peer = "%s:%d" % writer.get_extra_info("peername")[:2]
+        self.connections += 1
+        try:
+            while True:
+                raw = await reader.readexactly(tf.FRAME.size)
+                frame = tf.unpack(raw)
+                if frame is None:
+                    # Fixed-size frames: a bad header means we lost framing
+                    self.bad_frames += 1
+                    break
+                bed = self.beds.get(frame["bed"])
+                if bed is None:
+                    bed = self.beds[frame["bed"]] = Bed(frame["bed"], self.history)
+                bed.add(raw, frame, peer)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            self.connections -= 1
+            writer.close()
+
+    async def handle_http(self, reader, writer):
+        try:
+            request = await reader.readline()
+            while (await reader.readline()) not in (b"\r\n", b"\n", b""):
+                pass
+            parts = request.decode("latin-1").split()
+            if len(parts) < 2 or parts[0] != "GET":
+                await self.respond(writer, 405, "text/plain", b"Method Not Allowed")
+                return
+            url = urlsplit(parts[1])
+            status, ctype, body = self.route(url.path, parse_qs(url.query))
+            await self.respond(writer, status, ctype, body)
+        except ConnectionError:
+            pass
+        finally:
+            writer.close()
+
+    def route(self, path, query):
+        if path == "/":
+            return 200, "text/html; charset=utf-8", DASHBOARD_HTML.encode()
+        if path == "/api/beds":
+            body = {
+                "connections": self.connections,
+                "bad_frames": self.bad_frames,
+                "beds": [self.beds[k].summary() for k in sorted(self.beds)],
+            }
+            return 200, "application/json", json.dumps(body).encode()
+        if path.startswith("/api/beds/"):
+            try:
+                bed = self.beds[int(path.rsplit("/", 1)[1])]
+                n = int(query.get("n", ["60"])[0])
+            except (KeyError, ValueError):
+                return 404, "text/plain", b"Not Found"
+            return 200, "application/json", json.dumps(bed.recent(n)).encode()
+        return 404, "text/plain", b"Not Found"
+
+    @staticmethod
+    async def respond(writer, status, ctype, body):
+        reason = {200: "OK", 404: "Not Found", 405: "Method Not Allowed"}[status]
+        head = ("HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+                "Cache-Control: no-store\r\nConnection: close\r\n\r\n"
+                % (status, reason, ctype, len(body)))
+        writer.write(head.encode() + body)
+        await writer.drain()
+
+
+DASHBOARD_HTML = """<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Central Station</title>
+<style>
+body { font-family: sans-serif; background: #111; color: #eee; margin: 1rem; }
+#grid { display: grid; grid-template-columns: repeat(auto-fill, minmax(170px, 1fr)); gap: 0.5rem; }
+.bed { background: #222; border-radius: 6px; padding: 0.5rem; border-left: 6px solid #2a2; }
+.bed.alarm { border-color: #d22; background: #3a1515; }
+.bed.acked { border-color: #d92; }
+.bed.offline { opacity: 0.4; border-color: #666; }
+.id { font-weight: bold; }
+.v { font-size: 1.4rem; }
+.small { font-size: 0.75rem; color: #aaa; }
+</style></head><body>
+<h2>Central Station <span class="small" id="summary"></span></h2>
+<div id="grid"></div>
+<script>
+const fmt = v => v === null ? '--' : v;
+async function refresh() {
+  try {
+    const d = await (await fetch('/api/beds')).json();
+    document.getElementById('summary').textContent =
+      d.beds.length + ' beds, ' + d.connections + ' connected';
+    document.getElementById('grid').innerHTML = d.beds.map(b => {
+      const f = b.latest || {};
+      const cls = !b.online ? 'offline' : f.alarm ? (f.alarm_acked ? 'acked' : 'alarm') : '';
+      return '<div class="bed ' + cls + '"><div class="id">Bed ' + b.bed + '</div>' +
+        '<div class="v">SpO2 ' + fmt(f.spo2) + '% &middot; HR ' + fmt(f.hr) + '</div>' +
+        '<div>' + fmt(f.temp_f) + ' &deg;F &middot; ' + fmt(f.target_bpm) + ' BPM' +
+        (f.running ? '' : ' (stopped)') + ' &middot; SQI ' + fmt(f.sqi) + '</div>' +
+        '<div class="small">' + (f.alarms && f.alarms.length ? f.alarms.join(', ') : 'no alarms') +
+        ' &middot; ' + b.age_s + ' s ago &middot; lost ' + b.gaps + '</div></div>';
+    }).join('');
+  } catch (e) { /* keep the last view */ }
+}
+setInterval(refresh, 1000);
+refresh();
+</script></body></html>
+"""
+
+
+async def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--bind", default="0.0.0.0")
+    ap.add_argument("--ingest-port", type=int, default=7700)
+    ap.add_argument("--http-port", type=int, default=8080)
+    ap.add_argument("--history", type=int, default=3600,
+                    help="frames kept per bed (default: 1 h at 1 Hz)")
+    args = ap.parse_args()
+
+    agg = Aggregator(args.history)
+    ingest = await asyncio.start_server(agg.handle_device, args.bind, args.ingest_port)
+    http = await asyncio.start_server(agg.handle_http, args.bind, args.http_port)
+    print("Ingest on %s:%d, dashboard on http://%s:%d/"
+          % (args.bind, args.ingest_port, args.bind, args.http_port))
+    async with ingest, http:
+        await asyncio.gather(ingest.serve_forever(), http.serve_forever())
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
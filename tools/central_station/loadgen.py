@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Simulates N ventilators pushing telemetry to the aggregator.
+
+    python3 loadgen.py --beds 100 --rate 1 --duration 60
+    python3 loadgen.py --multicast 239.255.77.1:7701 --rate 5 --drop 0.01
+
+Each bed sends frames at --rate Hz with slowly drifting vitals and the
+occasional SpO2 dip, so alarms show up on the dashboard. By default each
+bed is one TCP connection to the aggregator; with --multicast it sends
+datagrams to the group instead, optionally dropping a --drop fraction of
+them to exercise multicast_listener.py. Prints the achieved aggregate
+frame rate when done.
+"""
+
+import argparse
+import asyncio
+import math
+import random
+import socket
+import time
+
+import telemetry_frame as tf
+
+
+class MulticastWriter:
+    """Minimal stand-in for a StreamWriter that sends each write as a datagram."""
+
+    def __init__(self, group, port, drop, rng):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+        self.addr = (group, port)
+        self.drop = drop
+        self.rng = rng
+
+    def write(self, data):
+        if self.rng.random() >= self.drop:
+            self.sock.sendto(data, self.addr)
+
+    async def drain(self):
+        pass
+
+    def close(self):
+        self.sock.close()
+
+
+async def bed(bed_id, args, counters):
+    rng = random.Random(bed_id)
+    if args.multicast:
+        group, port = args.multicast.rsplit(":", 1)
+        writer = MulticastWriter(group, int(port), args.drop, rng)
+    else:
+        _, writer = await asyncio.open_connection(args.host, args.port)
+    period = 1.0 / args.rate
+    phase = rng.random() * 2 * math.pi
+    # Stagger starts so frames do not all land in the same instant
+    await asyncio.sleep(rng.random() * period)
+
+    seq = 0
+    next_t = time.monotonic()
+    end_t = next_t + args.duration if args.duration > 0 else math.inf
+    while time.monotonic() < end_t:
+        seq += 1
+        t = time.monotonic()
+        spo2 = 96 + 2 * math.sin(t / 30 + phase) + rng.uniform(-0.5, 0.5)
+        if rng.random() < 0.002:
+            spo2 = 78.0
+        alarm_mask = 1 if spo2 < 80 else 0
+        flags = tf.FLAG_RUNNING | tf.FLAG_SENSOR_OK | tf.FLAG_WALL_CLOCK
+        if alarm_mask:
+            flags |= tf.FLAG_ALARM
+        bpm = 15 if spo2 >= 95 else 17 if spo2 >= 90 else 20
+        writer.write(tf.pack(
+            bed_id=bed_id, seq=seq, time_ms=int(time.time() * 1000),
+            spo2=spo2, heart_rate=72 + 8 * math.sin(t / 20 + phase),
+            temp_f=98.4 + rng.uniform(-0.2, 0.2), servo_angle=rng.uniform(0, 90),
+            target_bpm=bpm, flags=flags,
+            alarm_priority=3 if alarm_mask else 0, alarm_mask=alarm_mask,
+            sqi=rng.randint(70, 100)))
+        await writer.drain()
+        counters[0] += 1
+
+        next_t += period
+        await asyncio.sleep(max(0.0, next_t - time.monotonic()))
+    writer.close()
+
+
+async def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=7700)
+    ap.add_argument("--beds", type=int, default=100)
+    ap.add_argument("--rate", type=float, default=1.0, help="frames per second per bed")
+    ap.add_argument("--duration", type=float, default=0, help="seconds, 0 = forever")
+    ap.add_argument("--multicast", metavar="GROUP:PORT",
+                    help="send UDP multicast datagrams instead of pushing over TCP")
+    ap.add_argument("--drop", type=float, default=0.0,
+                    help="fraction of multicast datagrams to drop (tests loss detection)")
+    args = ap.parse_args()
+
+    counters = [0]
+    start = time.monotonic()
+    try:
+        await asyncio.gather(*(bed(i + 1, args, counters) for i in range(args.beds)))
+    finally:
+        elapsed = time.monotonic() - start
+        print("%d beds sent %d frames in %.1f s (%.0f frames/s)"
+              % (args.beds, counters[0], elapsed, counters[0] / elapsed))
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
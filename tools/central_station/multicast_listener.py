@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Reference listener for the firmware's UDP multicast telemetry.
+
+    python3 multicast_listener.py --group 239.255.77.1 --port 7701
+
+Joins the group and prints per-bed statistics every --interval seconds:
+frames received, frames lost (gaps in seq), duplicates / out-of-order,
+device restarts, inter-arrival time and, for frames stamped with the wall
+clock, one-way latency. Latency includes any offset between the device
+clock (set from a browser via /set_time) and this host's clock, so read
+it as relative; inter-arrival time does not depend on either clock.
+"""
+
+import argparse
+import socket
+import statistics
+import struct
+import time
+
+import telemetry_frame as tf
+
+# A drop this large in seq is a device restart, not reordering
+RESTART_BACKSTEP = 1000
+# Gaps are remembered individually up to this size so late arrivals can fill them
+MAX_TRACKED_GAP = 1000
+
+
+class BedStats:
+    def __init__(self):
+        self.highest = None  # Highest seq seen
+        self.received = 0
+        self.lost = 0
+        self.missing = set()  # seqs counted as lost that may still arrive late
+        self.reordered = 0
+        self.duplicates = 0
+        self.restarts = 0
+        self.last_rx = None
+        self.intervals = []  # Seconds between arrivals, this report window
+        self.latencies = []  # ms, wall-clock frames only, this report window
+
+    def add(self, frame, rx_time):
+        seq = frame["seq"]
+        if self.highest is None:
+            self.highest = seq
+        elif seq > self.highest:
+            gap = seq - self.highest - 1
+            self.lost += gap
+            if gap <= MAX_TRACKED_GAP:
+                self.missing.update(range(self.highest + 1, seq))
+            self.highest = seq
+        elif self.highest - seq >= RESTART_BACKSTEP or seq == 1:
+            self.restarts += 1
+            self.highest = seq
+            self.missing.clear()
+        elif seq in self.missing:
+            self.missing.discard(seq)
+            self.lost -= 1
+            self.reordered += 1
+        else:
+            self.duplicates += 1
+            return
+        self.received += 1
+        if len(self.missing) > MAX_TRACKED_GAP:
+            self.missing = {s for s in self.missing if s > self.highest - MAX_TRACKED_GAP}
+
+        if self.last_rx is not None:
+            self.intervals.append(rx_time - self.last_rx)
+        self.last_rx = rx_time
+        if frame["wall_clock"]:
+            self.latencies.append(rx_time * 1000.0 - frame["time_ms"])
+
+    def report(self, bed_id):
+        expected = self.received + self.lost
+        loss = 100.0 * self.lost / expected if expected else 0.0
+        line = "bed %3d  rx %7d  lost %5d (%5.2f%%)  reordered %d  dup %d  restarts %d" % (
+            bed_id, self.received, self.lost, loss, self.reordered, self.duplicates, self.restarts)
+        if len(self.intervals) >= 2:
+            ms = sorted(v * 1000.0 for v in self.intervals)
+            line += "  gap ms p50 %.0f p99 %.0f max %.0f" % (
+                statistics.median(ms), ms[int(0.99 * (len(ms) - 1))], ms[-1])
+        if self.latencies:
+            lat = sorted(self.latencies)
+            line += "  latency ms p50 %.1f p99 %.1f" % (
+                statistics.median(lat), lat[int(0.99 * (len(lat) - 1))])
+        self.intervals.clear()
+        self.latencies.clear()
+        return line
+
+
+def open_socket(group, port, iface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", port))
+    mreq = struct.pack("4s4s", socket.inet_aton(group), socket.inet_aton(iface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    return sock
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--group", default="239.255.77.1")
+    ap.add_argument("--port", type=int, default=7701)
+    ap.add_argument("--iface", default="0.0.0.0", help="local address to join on")
+    ap.add_argument("--interval", type=float, default=5.0, help="seconds between reports")
+    ap.add_argument("--duration", type=float, default=0, help="seconds, 0 = forever")
+    args = ap.parse_args()
+
+    sock = open_socket(args.group, args.port, args.iface)
+    sock.settimeout(0.5)
+    beds = {}
+    bad = 0
+    start = time.monotonic()
+    next_report = start + args.interval
+    print("Listening on %s:%d" % (args.group, args.port))
+
+    try:
+        while args.duration <= 0 or time.monotonic() - start < args.duration:
+            try:
+                data = sock.recv(2048)
+                rx_time = time.time()
+                frame = tf.unpack(data) if len(data) == tf.FRAME.size else None
+                if frame is None:
+                    bad += 1
+                else:
+                    beds.setdefault(frame["bed"], BedStats()).add(frame, rx_time)
+            except socket.timeout:
+                pass
+            if time.monotonic() >= next_report:
+                next_report += args.interval
+                for bed_id in sorted(beds):
+                    print(beds[bed_id].report(bed_id))
+                print("-- %d beds, %d bad datagrams" % (len(beds), bad))
+    except KeyboardInterrupt:
+        pass
+
+    for bed_id in sorted(beds):
+        print(beds[bed_id].report(bed_id))
+    print("-- %d beds, %d bad datagrams" % (len(beds), bad))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""End-to-end smoke test of the central station tools on one host.
+
+    python3 smoke_test.py                       # TCP: aggregator + 100 beds at 10 Hz
+    python3 smoke_test.py --multicast --drop 0.05   # UDP: listener + 20 beds at 5 Hz
+
+TCP mode starts aggregator.py on free ports, runs loadgen.py against it
+and then checks /api/beds: every bed present, frames received equal to
+frames sent, no seq gaps and no bad frames. On Linux it also prints the
+aggregator's peak RSS (VmHWM). Multicast mode starts multicast_listener.py,
+runs loadgen.py --multicast with --drop and checks that every bed was heard
+and that the reported loss is within a few points of --drop.
+
+Exits non-zero on failure. Expected output for the defaults, e.g.:
+
+    100 beds sent 8000 frames in 8.1 s (985 frames/s)
+    aggregator: 100 beds, 8000 frames, 0 gaps, 0 bad frames, peak RSS 37 MB
+    PASS
+"""
+
+import argparse
+import json
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+import urllib.request
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def free_port(kind=socket.SOCK_STREAM):
+    with socket.socket(socket.AF_INET, kind) as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def tool(name, *args):
+    return [sys.executable, os.path.join(HERE, name)] + [str(a) for a in args]
+
+
+def peak_rss_mb(pid):
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1]) / 1024.0
+    except OSError:
+        pass
+    return None
+
+
+def run_loadgen(*args):
+    out = subprocess.run(tool("loadgen.py", *args), capture_output=True, text=True,
+                         check=True).stdout
+    print(out.strip())
+    m = re.search(r"sent (\d+) frames", out)
+    return int(m.group(1)) if m else -1
+
+
+def check(failures, ok, what):
+    if not ok:
+        failures.append(what)
+
+
+def tcp(args):
+    ingest, http = free_port(), free_port()
+    agg = subprocess.Popen(tool("aggregator.py", "--bind", "127.0.0.1",
+                                "--ingest-port", ingest, "--http-port", http),
+                           stdout=subprocess.DEVNULL)
+    try:
+        deadline = time.monotonic() + 5
+        while True:
+            try:
+                socket.create_connection(("127.0.0.1", http), timeout=0.2).close()
+                break
+            except OSError:
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.1)
+
+        sent = run_loadgen("--port", ingest, "--beds", args.beds, "--rate", args.rate,
+                           "--duration", args.duration)
+        time.sleep(1.0)  # Let the last frames drain
+        with urllib.request.urlopen("http://127.0.0.1:%d/api/beds" % http, timeout=5) as r:
+            body = json.load(r)
+        rss = peak_rss_mb(agg.pid)
+    finally:
+        agg.terminate()
+        agg.wait()
+
+    beds = body["beds"]
+    frames = sum(b["frames"] for b in beds)
+    gaps = sum(b["gaps"] for b in beds)
+    print("aggregator: %d beds, %d frames, %d gaps, %d bad frames%s"
+          % (len(beds), frames, gaps, body["bad_frames"],
+             ", peak RSS %.0f MB" % rss if rss is not None else ""))
+
+    failures = []
+    check(failures, len(beds) == args.beds, "bed count")
+    check(failures, frames == sent, "frames received != sent")
+    check(failures, gaps == 0, "seq gaps")
+    check(failures, body["bad_frames"] == 0, "bad frames")
+    if rss is not None and args.max_rss_mb > 0:
+        check(failures, rss <= args.max_rss_mb, "peak RSS above %d MB" % args.max_rss_mb)
+    return failures
+
+
+def multicast(args):
+    port = free_port(socket.SOCK_DGRAM)
+    listener = subprocess.Popen(
+        tool("multicast_listener.py", "--group", args.group, "--port", port,
+             "--interval", 3600, "--duration", args.duration + 2),
+        stdout=subprocess.PIPE, text=True)
+    time.sleep(0.5)  # Joined before the first datagram
+    run_loadgen("--multicast", "%s:%d" % (args.group, port), "--beds", args.beds,
+                "--rate", args.rate, "--duration", args.duration, "--drop", args.drop)
+    out, _ = listener.communicate(timeout=args.duration + 10)
+
+    losses = [float(m) for m in re.findall(r"lost +\d+ \( *([\d.]+)%\)", out)]
+    heard = len(losses)
+    mean = sum(losses) / heard if heard else float("nan")
+    print("listener: %d beds heard, mean loss %.2f%% (drop %.2f%%)" % (heard, mean, 100 * args.drop))
+
+    failures = []
+    check(failures, heard == args.beds, "beds heard")
+    check(failures, heard > 0 and abs(mean - 100 * args.drop) <= args.loss_tolerance,
+          "loss not within %.1f points of --drop" % args.loss_tolerance)
+    return failures
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--multicast", action="store_true", help="test the UDP path instead of TCP")
+    ap.add_argument("--group", default="239.255.77.1")
+    ap.add_argument("--beds", type=int)
+    ap.add_argument("--rate", type=float)
+    ap.add_argument("--duration", type=float, default=8.0)
+    ap.add_argument("--drop", type=float, default=0.05)
+    ap.add_argument("--loss-tolerance", type=float, default=2.0, help="percentage points")
+    ap.add_argument("--max-rss-mb", type=float, default=40.0, help="0 = do not check")
+    args = ap.parse_args()
+    if args.beds is None:
+        args.beds = 20 if args.multicast else 100
+    if args.rate is None:
+        args.rate = 5.0 if args.multicast else 10.0
+
+    failures = multicast(args) if args.multicast else tcp(args)
+    for f in failures:
+        print("FAIL: " + f)
+    print("PASS" if not failures else "FAILED")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,65 @@
+"""Binary telemetry frame shared with the firmware (TelemetryFrame in src/main.cpp).
+
+Fixed-size, little-endian. Keep this in step with the C++ struct and bump
+VERSION on any layout change.
+"""
+
+import math
+import struct
+
+MAGIC = 0x4C545644  # "DVTL"
+VERSION = 2  # 2: sqi in the former reserved byte, signal_poor alarm
+
+FLAG_RUNNING = 1 << 0
+FLAG_MANUAL = 1 << 1
+FLAG_SENSOR_OK = 1 << 2
+FLAG_ALARM = 1 << 3
+FLAG_ALARM_ACKED = 1 << 4
+FLAG_WALL_CLOCK = 1 << 5  # time_ms is epoch ms, else device uptime ms
+
+# Same order as kAlarmRules in the firmware
+ALARM_RULES = ("spo2_low", "temp_low", "hr_low", "hr_high",
+               "sensor_lost", "spo2_stale", "servo_stall", "signal_poor",
+               "temp_stale")
+
+FRAME = struct.Struct("<IBBHIQffffHBBI")
+assert FRAME.size == 44
+
+
+def pack(bed_id, seq, time_ms, spo2, heart_rate, temp_f, servo_angle,
+         target_bpm, flags=0, alarm_priority=0, alarm_mask=0, sqi=0):
+    return FRAME.pack(MAGIC, VERSION, flags, bed_id, seq, time_ms,
+                      spo2, heart_rate, temp_f, servo_angle,
+                      target_bpm, alarm_priority, sqi, alarm_mask)
+
+
+def unpack(buf):
+    """Returns a dict for a valid frame, or None if magic/version do not match."""
+    (magic, version, flags, bed_id, seq, time_ms, spo2, heart_rate, temp_f,
+     servo_angle, target_bpm, alarm_priority, sqi, alarm_mask) = FRAME.unpack(buf)
+    if magic != MAGIC or version != VERSION:
+        return None
+    return {
+        "bed": bed_id,
+        "seq": seq,
+        "time_ms": time_ms,
+        "wall_clock": bool(flags & FLAG_WALL_CLOCK),
+        "running": bool(flags & FLAG_RUNNING),
+        "manual": bool(flags & FLAG_MANUAL),
+        "sensor_ok": bool(flags & FLAG_SENSOR_OK),
+        "alarm": bool(flags & FLAG_ALARM),
+        "alarm_acked": bool(flags & FLAG_ALARM_ACKED),
+        "alarm_priority": alarm_priority,
+        "alarms": [name for i, name in enumerate(ALARM_RULES) if alarm_mask & (1 << i)],
+        "spo2": _num(spo2),
+        "hr": _num(heart_rate),
+        "temp_f": _num(temp_f),
+        "servo_angle": _num(servo_angle),
+        "target_bpm": target_bpm,
+        "sqi": sqi,
+    }
+
+
+def _num(v):
+    # NAN marks missing data on the device; JSON has no NaN
+    return None if math.isnan(v) else round(v, 1)
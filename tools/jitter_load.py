@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Measures control-task jitter on a ventilator while clients load its web server.
+
+    python3 jitter_load.py --host 192.168.4.1 --clients 5 --duration 60
+
+Each client polls /status like an open dashboard (every --interval seconds)
+and every --download seconds also fetches /get_data?duration=60. The
+script reads control_jitter_hist / control_jitter_max_us from /status
+before and after the run and prints the histogram delta, so the result
+covers only ticks taken under load. Run it once per firmware build to
+compare builds; the counters are cumulative since boot, so the max is
+only meaningful right after a reboot. Standard library only.
+"""
+
+import argparse
+import json
+import threading
+import time
+import urllib.request
+
+# Upper edges of the firmware's kJitterBucketUs; the last bucket is open-ended
+BUCKET_US = [50, 100, 250, 500, 1000, 2000]
+
+
+def fetch(host, path, timeout=5.0):
+    with urllib.request.urlopen(f"http://{host}{path}", timeout=timeout) as resp:
+        return resp.read()
+
+
+def read_jitter(host):
+    status = json.loads(fetch(host, "/status"))
+    return status["control_jitter_hist"], status["control_jitter_max_us"]
+
+
+def client(args, stop, counters, lock):
+    next_download = time.monotonic() + args.download
+    while not stop.is_set():
+        path = "/status"
+        if args.download > 0 and time.monotonic() >= next_download:
+            path = "/get_data?duration=60"
+            next_download += args.download
+        try:
+            fetch(args.host, path)
+            key = "ok"
+        except OSError:
+            key = "errors"
+        with lock:
+            counters[key] += 1
+        stop.wait(args.interval)
+
+
+def bucket_label(i):
+    if i == 0:
+        return f"< {BUCKET_US[0]} us"
+    if i < len(BUCKET_US):
+        return f"{BUCKET_US[i - 1]}-{BUCKET_US[i]} us"
+    return f">= {BUCKET_US[-1]} us"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--clients", type=int, default=5)
+    parser.add_argument("--duration", type=float, default=60.0)
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between polls per client")
+    parser.add_argument("--download", type=float, default=15.0, help="seconds between CSV downloads (0 = none)")
+    args = parser.parse_args()
+
+    before, _ = read_jitter(args.host)
+    stop = threading.Event()
+    lock = threading.Lock()
+    counters = {"ok": 0, "errors": 0}
+    threads = [threading.Thread(target=client, args=(args, stop, counters, lock)) for _ in range(args.clients)]
+    for t in threads:
+        t.start()
+    time.sleep(args.duration)
+    stop.set()
+    for t in threads:
+        t.join()
+    after, max_us = read_jitter(args.host)
+
+    delta = [a - b for a, b in zip(after, before)]
+    ticks = sum(delta)
+    print(f"{args.clients} clients, {counters['ok']} requests, {counters['errors']} errors, {ticks} control ticks")
+    for i, n in enumerate(delta):
+        share = 100.0 * n / ticks if ticks else 0.0
+        print(f"  {bucket_label(i):>14}: {n:8d}  {share:6.2f}%")
+    print(f"  max since boot: {max_us} us")
+
+
+if __name__ == "__main__":
+    main()
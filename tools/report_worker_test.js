@@ -0,0 +1,122 @@
+#!/usr/bin/env node
+// Runs the dashboard's report worker (the text/js-worker block in
+// src/main.cpp) under Node 18+ and checks it against a direct computation.
+//
+//     node tools/report_worker_test.js
+//
+// The CSV is served as a ReadableStream cut into odd-sized chunks, so line
+// separators and multi-byte characters are split across reads. Two requests
+// are in flight at once to check that replies carry their own id.
+
+'use strict';
+
+const assert = require('assert');
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+const SRC = path.join(__dirname, '..', 'src', 'main.cpp');
+const cpp = fs.readFileSync(SRC, 'utf8');
+const m = cpp.match(/<script type="text\/js-worker" id="report-worker">([\s\S]*?)<\/script>/);
+assert(m, 'report-worker script block not found in ' + SRC);
+
+// handleGetData() ends each line with a literal backslash-n (see LINE_SEP)
+const SEP = '\\n';
+const HEADER = 'Timestamp,SpO2 (%),Heart Rate (BPM),Temperature (°F),Ventilation Rate (BPM)';
+
+function makeCsv(rows, seed) {
+  let x = seed;
+  const rand = () => (x = (x * 1103515245 + 12345) % 2147483648) / 2147483648;
+  const data = [];
+  for (let i = 0; i < rows; i++) {
+    const bad = i % 17 === 5; // Rows with missing values count in the table but not the stats
+    data.push([
+      '2026-10-16 12:' + String(i % 60).padStart(2, '0') + ':00',
+      bad ? 'nan' : (88 + rand() * 12).toFixed(1),
+      (60 + rand() * 50).toFixed(1),
+      (96 + rand() * 4).toFixed(1),
+      String(15 + Math.floor(rand() * 6)),
+    ]);
+  }
+  return { data, text: HEADER + SEP + data.map(r => r.join(',')).join(SEP) + SEP };
+}
+
+function expectedStats(data) {
+  const valid = data.filter(r => r.slice(1).every(v => !isNaN(parseFloat(v))));
+  const col = i => valid.map(r => parseFloat(r[i]));
+  const avg = a => a.reduce((s, v) => s + v, 0) / a.length;
+  return {
+    count: valid.length,
+    spo2Avg: avg(col(1)).toFixed(1),
+    spo2Min: Math.min(...col(1)).toFixed(1),
+    spo2Max: Math.max(...col(1)).toFixed(1),
+    hrAvg: avg(col(2)).toFixed(0),
+    bpmMin: Math.min(...col(4)),
+    bpmMax: Math.max(...col(4)),
+  };
+}
+
+function chunkedResponse(text, seed) {
+  const bytes = new TextEncoder().encode(text);
+  let pos = 0;
+  let x = seed;
+  return new Response(new ReadableStream({
+    pull(controller) {
+      if (pos >= bytes.length) {
+        controller.close();
+        return;
+      }
+      x = (x * 48271) % 2147483647;
+      const n = 1 + (x % 37);
+      controller.enqueue(bytes.slice(pos, pos + n));
+      pos += n;
+    },
+  }));
+}
+
+async function main() {
+  const csvs = { '/a': makeCsv(100, 1), '/b': makeCsv(250, 2) };
+  const replies = [];
+  const self = { postMessage: msg => replies.push(msg) };
+  const context = vm.createContext({
+    self, Blob, TextDecoder, ReadableStream, Date,
+    fetch: async url => chunkedResponse(csvs[url].text, url.length * 7919 + url.charCodeAt(1)),
+  });
+  vm.runInContext(m[1], context, { filename: 'report-worker' });
+
+  await Promise.all([
+    self.onmessage({ data: { id: 1, url: '/a', duration: '1h' } }),
+    self.onmessage({ data: { id: 2, url: '/b', duration: '6h' } }),
+  ]);
+  assert.strictEqual(replies.length, 2);
+
+  for (const [id, url, duration] of [[1, '/a', '1H'], [2, '/b', '6H']]) {
+    const reply = replies.find(r => r.id === id);
+    assert(reply && !reply.error, 'reply ' + id + ': ' + (reply && reply.error));
+    const html = await reply.blob.text();
+    const { data } = csvs[url];
+    const exp = expectedStats(data);
+
+    assert.strictEqual((html.match(/<tr><td>/g) || []).length, data.length, 'table rows');
+    assert(html.includes('<th>Temperature (°F)</th>'), 'header cells');
+    assert(html.includes(duration + ' • ' + exp.count + ' Readings'), 'valid count');
+    assert(html.includes('>' + exp.spo2Avg + '<span'), 'SpO2 average ' + exp.spo2Avg);
+    assert(html.includes('Range: ' + exp.spo2Min + '% - ' + exp.spo2Max + '%'), 'SpO2 range');
+    assert(html.includes('>' + exp.hrAvg + '<span style="font-size:1rem">BPM'), 'HR average');
+    assert(html.includes('Range: ' + exp.bpmMin + ' - ' + exp.bpmMax + ' BPM'), 'rate range');
+    console.log('request %d: %d rows, %d valid, SpO2 avg %s (%s-%s) ok',
+                id, data.length, exp.count, exp.spo2Avg, exp.spo2Min, exp.spo2Max);
+  }
+
+  // An HTTP error comes back as an error reply with the same id
+  context.fetch = async () => new Response('log empty', { status: 404 });
+  await self.onmessage({ data: { id: 3, url: '/c', duration: 'all' } });
+  const err = replies.find(r => r.id === 3);
+  assert(err && err.error && err.error.includes('log empty'), 'error reply');
+  console.log('PASS');
+}
+
+main().catch(e => {
+  console.error(e);
+  process.exit(1);
+});